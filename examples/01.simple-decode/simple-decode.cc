@@ -28,7 +28,7 @@ entry() {
     Debug::log("  Result: {}", r);
 
     Debug::log("Initializing QOI stream");
-    qoi_stream stream;
+    qoi_stream stream = {};
     stream.in_buf = qoi_data;
     stream.in_buf_size = sizeof(qoi_data);
 
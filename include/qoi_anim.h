@@ -0,0 +1,58 @@
+#pragma once
+
+#include <qoi_decode.h>
+#include <stddef.h>
+
+// Encoder for `qoia` animations, as decoded by `qoi_decode`. Frames
+// that have a previous frame are coded as spans of changed pixels, so
+// their size scales with the amount of motion rather than the frame
+// size.
+
+// State of an animation encoder.
+typedef struct {
+  qoi_desc desc;
+  uint32_t px_prev;
+  uint32_t index[64];
+  // Optional preset dictionary for frames that do not carry over the
+  // state of the one before, as passed to the decoder. Set by the
+  // caller.
+  const qoi_dictionary* dictionary;
+} qoi_anim_encoder;
+
+// Runs of unchanged pixels shorter than this are coded as part of the
+// surrounding span rather than skipped.
+#define QOI_ANIM_MIN_SKIP 8
+
+// Sizes of the animation header and tail.
+#define QOI_ANIM_HEADER_SIZE 14
+#define QOI_ANIM_TAIL_SIZE 8
+
+// Largest number of bytes `qoi_anim_encode_frame` can produce for a
+// frame of `pixels` pixels.
+#define QOI_ANIM_FRAME_SIZE_MAX(pixels) \
+  (1 + 5 * (size_t)(pixels) +           \
+   10 * ((size_t)(pixels) / (QOI_ANIM_MIN_SKIP + 1) + 2))
+
+// Initializes `encoder` for frames described by `desc` and writes the
+// animation header. Returns the number of bytes written, 0 if
+// `out_size` is too small, or `QOI_STATUS_ERR_PARAM` for a `desc` that
+// `qoi_decode` would not accept.
+__DECL ptrdiff_t __cheri_libcall
+qoi_anim_encode_header(qoi_anim_encoder* encoder, const qoi_desc* desc,
+                       unsigned char* out, size_t out_size);
+
+// Encodes one frame of `desc.channels` bytes per pixel. If
+// `prev_pixels` is not NULL, only the pixels that differ from it are
+// coded. `frame_flags` may contain `QOI_ANIM_FRAME_CARRY` to continue
+// from the previous frame's `index` and previous pixel. Returns the
+// number of bytes written, or 0 (leaving `encoder` unchanged) if
+// `out_size` is too small.
+__DECL size_t __cheri_libcall qoi_anim_encode_frame(
+    qoi_anim_encoder* encoder, const unsigned char* pixels,
+    const unsigned char* prev_pixels, uint8_t frame_flags,
+    unsigned char* out, size_t out_size);
+
+// Writes the tail that ends the animation. Returns the number of
+// bytes written, or 0 if `out_size` is too small.
+__DECL size_t __cheri_libcall qoi_anim_encode_tail(unsigned char* out,
+                                                   size_t out_size);
@@ -1,17 +1,17 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
 
 #ifdef __CHERIOT__
 #include <cdefs.h>
 #include <compartment-macros.h>
 #include <compartment.h>
 #else
-#include <string.h>
-
 // Define away some CHERIoT macros when building for host.
 #define DECLARE_AND_DEFINE_STATIC_SEALED_VALUE(a, b, c, d, e, f)
 #define __cheri_compartment(a)
+#define __cheri_libcall
 #define __sealed_capability
 #define __DECL
 #endif
@@ -21,9 +21,32 @@ typedef struct {
   unsigned int width;
   unsigned int height;
   uint8_t channels;
+  // 0 for sRGB colour with linear alpha, otherwise all linear.
   uint8_t colorspace;
 } qoi_desc;
 
+// A preset dictionary: the previous pixel and `index` that an image
+// starts from, instead of opaque black and a zeroed `index`. An image
+// encoded with a dictionary must be decoded with the same one. Pixels
+// have the red channel in the least significant byte.
+typedef struct {
+  uint32_t px_prev;
+  uint32_t index[64];
+} qoi_dictionary;
+
+// A point in an encoded `qoif` image at which decoding can start,
+// given the decoder state there, as recorded by
+// `qoi_encode_host_parallel`. Pixels are held as in
+// `qoi_decoder_state`, with R in the low byte.
+typedef struct {
+  // Offset in bytes of an opcode in the encoded image.
+  size_t offset;
+  // Index of the first pixel decoded from that opcode.
+  size_t pixel;
+  uint32_t px_prev;
+  uint32_t index[64];
+} qoi_checkpoint;
+
 // Private internal decoder state.
 typedef struct {
   uint8_t progress;
@@ -32,10 +55,33 @@ typedef struct {
   uint32_t index[64];
   union {
     uint32_t v;
-    uint8_t b[4];
+    uint8_t b[16];
   } tmp_buf;
   uint8_t tmp_buf_size;
-  uint8_t pending_run_count;
+  uint32_t pending_run_count;
+  uint8_t container;
+  uint8_t frame_flags;
+  uint32_t frame;
+  size_t span_remaining;
+  size_t total_in;
+  size_t total_pixels;
+  uint32_t checksum;
+  uint32_t column;
+  uint32_t row;
+  uint32_t px_out;
+  uint8_t px_out_valid;
+  uint8_t luma_prev;
+  uint8_t alpha;
+  uint8_t bits;
+  uint8_t bit_count;
+  uint64_t palette_valid;
+  uint8_t palette_slot[64];
+  uint8_t pixel_size;
+  uint8_t keyed;
+  uint8_t in_span;
+  uint8_t pass;
+  uint8_t profile;
+  uint32_t *index_big;
 } qoi_decoder_state;
 
 // Can be used to statically define a `qoi_decoder_state` in the
@@ -44,6 +90,31 @@ typedef struct {
   DECLARE_AND_DEFINE_STATIC_SEALED_VALUE(qoi_decoder_state, qoi_decode, \
                                          QOIDecoderStateKey, name, {})
 
+// Private internal state of `QOI_PROFILE_EXTENDED`, kept apart from
+// `qoi_decoder_state` and `qoi_encoder_state` so that only users of
+// `qoix` images pay for its big index.
+typedef struct {
+  uint32_t index_big[256];
+} qoi_extended_state;
+
+// Can be used to statically define a `qoi_extended_state` for the
+// decoder in the calling compartment.
+#define DECLARE_AND_DEFINE_QOI_EXTENDED_DECODER(name)                    \
+  DECLARE_AND_DEFINE_STATIC_SEALED_VALUE(qoi_extended_state, qoi_decode, \
+                                         QOIExtendedStateKey, name, {})
+
+// Describes a span of pixels within the current image or frame.
+typedef struct {
+  // Index of the first pixel of the span, in raster order.
+  size_t offset;
+  // Number of pixels in the span.
+  size_t length;
+} qoi_span;
+
+// The buffers and options of a decode. Fields that select options
+// default to zero, so a stream must be zero-initialized, as with
+// `qoi_stream stream = {};`, before setting the fields that are used.
+// Otherwise it may be rejected or decoded with arbitrary options.
 typedef struct {
   // Points to the next byte of input to be consumed.
   const unsigned char* in_buf;
@@ -58,21 +129,392 @@ typedef struct {
   // Parsed QOI file header.
   qoi_desc desc;
 
+  // Combination of `QOI_FLAG_*` values. Must not be changed while
+  // an image is being decoded.
+  uint32_t flags;
+
+  // Layout of the pixels written to `out_buf`, one of `QOI_FORMAT_*`.
+  // Must not be changed while an image is being decoded.
+  uint8_t format;
+
+  // Luma or alpha above which `QOI_FORMAT_MONO1` and
+  // `QOI_FORMAT_ALPHA1` pixels are set, unless `QOI_FLAG_DITHER` is
+  // used. Also used for `row_summary`.
+  uint8_t threshold;
+
+  // Optional bitmap with one bit per image row, most significant bit
+  // first, of `row_summary_size` bytes. The bit for a row is set when
+  // any of its pixels has an alpha above `threshold`. Bits are never
+  // cleared, so the bitmap should be zeroed before decoding.
+  uint8_t* row_summary;
+  size_t row_summary_size;
+
+  // Colour to blend pixels over with `QOI_FLAG_BLEND_COLOR`, with the
+  // red channel in the least significant byte.
+  uint32_t background;
+
+  // Optional lookup tables applied to each decoded pixel before any
+  // other processing: 256 entries for each of red, green and blue, then
+  // optionally alpha, so `lut_size` is 0, 768 or 1024. The alpha table
+  // is only used for 4-channel images. Must not be changed while an
+  // image is being decoded.
+  const uint8_t* lut;
+  size_t lut_size;
+
+  // Optional preset dictionary loaded at the start of each image, and
+  // of each animation frame that does not carry over the state of the
+  // one before. Must not be changed while an image is being decoded.
+  const qoi_dictionary* dictionary;
+
+  // Table of `QOI_PALETTE_LUT_SIZE` bytes used by `QOI_FORMAT_INDEX8`,
+  // as filled by `qoi_palette_lut`. Must not be changed while an image
+  // is being decoded.
+  const uint8_t* palette_lut;
+
+  // Distance in bytes between the planes written with
+  // `QOI_FLAG_PLANAR`.
+  size_t plane_pitch;
+
+  // Applied by `QOI_FLAG_NORMALIZE` to each output channel, in output
+  // order: `value * scale[i] + bias[i]` for 8-bit values in [0, 255].
+  float scale[4];
+  float bias[4];
+
+  // Colour whose pixels are not written with `QOI_FLAG_COLOR_KEY`,
+  // with the red channel in the least significant byte. Alpha is
+  // ignored.
+  uint32_t color_key;
+
+  // Index of the current image within a multi-frame stream. Updated
+  // together with `desc` once each image header has been parsed.
+  uint32_t frame;
+
+  // Span of pixels reported by `QOI_STATUS_SPAN`,
+  // `QOI_STATUS_OPAQUE_SPAN` or `QOI_STATUS_RUN`.
+  qoi_span span;
+
+  // Pixel repeated by the run reported by `QOI_STATUS_RUN`, as the
+  // bytes that would have been written to `out_buf`, in memory order.
+  uint32_t run_color;
+
+  // Number of input bytes consumed and pixels decoded since the
+  // decoder was initialized. Updated on every return.
+  size_t total_in;
+  size_t total_pixels;
+
+  // Input offset of the element that caused the most recent
+  // `QOI_STATUS_ERR_FORMAT`.
+  size_t error_offset;
+
+  // CRC32C of the decoded pixels of the most recently completed image
+  // or frame, when `QOI_FLAG_CHECKSUM` is set.
+  uint32_t checksum;
+
   // Private internal decoder state.
   qoi_decoder_state* __sealed_capability decoder_state;
+  // Private internal state for `qoix` images, which cannot be decoded
+  // without it: `qoi_decode` returns `QOI_STATUS_ERR_PARAM` after
+  // their header while this is NULL, and can then be called again with
+  // it set. Not needed with `QOI_FLAG_VALIDATE`. Must not be changed
+  // while such an image is being decoded.
+  qoi_extended_state* __sealed_capability extended_state;
 } qoi_stream;
 
+// Flags for `qoi_stream.flags`.
+//
+// Treat the input as a sequence of concatenated QOI images. Instead
+// of `QOI_STATUS_DONE`, each completed image returns
+// `QOI_STATUS_FRAME_DONE`, and the next call continues with the
+// header of the following image without re-initializing the decoder.
+#define QOI_FLAG_MULTI_FRAME (1u << 0)
+// Check the structure of the input, including the tail, without
+// reconstructing any pixels. `out_buf` is never written and may be
+// NULL. `total_pixels` still counts the pixels that would have been
+// decoded.
+#define QOI_FLAG_VALIDATE (1u << 1)
+// Compute a CRC32C of the decoded pixels, as `desc.channels` bytes in
+// RGB(A) order, while they are produced. The result is stored in
+// `checksum` when each image or animation frame is completed.
+#define QOI_FLAG_CHECKSUM (1u << 2)
+// The input lies at the end of the output buffer, as described for
+// `qoi_inplace_margin`. Output that would overwrite input that has
+// not been consumed yet fails with `QOI_STATUS_ERR_OVERLAP` instead.
+#define QOI_FLAG_IN_PLACE (1u << 3)
+// Use BT.709 rather than BT.601 weights to compute luma.
+#define QOI_FLAG_BT709 (1u << 4)
+// Apply ordered dithering in `QOI_FORMAT_MONO1`.
+#define QOI_FLAG_DITHER (1u << 5)
+// Multiply the colour channels by alpha.
+#define QOI_FLAG_PREMULTIPLY (1u << 6)
+// Blend each pixel over `background`, producing opaque output.
+#define QOI_FLAG_BLEND_COLOR (1u << 7)
+// Blend each pixel over the pixel already in `out_buf`, in the output
+// format. Fully transparent pixels are skipped without being written.
+// Pixels are only written whole, so `out_buf_size` must be a multiple
+// of the pixel size. Not supported by the 1-bit, linear or indexed
+// formats, or with `QOI_FLAG_PLANAR` or `QOI_FLAG_NORMALIZE`.
+#define QOI_FLAG_BLEND_DEST (1u << 8)
+// Write each channel to its own plane: plane `i` of a pixel starts
+// `i * plane_pitch` bytes after `out_buf`, and `out_buf_size` counts
+// the space remaining in the first plane. Only supported by the
+// formats with a fixed number of 8-bit channels, `QOI_FORMAT_RGB` to
+// `QOI_FORMAT_ABGR`, optionally with `QOI_FLAG_NORMALIZE`, and not
+// with `QOI_FLAG_IN_PLACE`.
+#define QOI_FLAG_PLANAR (1u << 9)
+// Write each channel as a native-endian float computed from `scale`
+// and `bias`, e.g. for mean and standard deviation normalization.
+// Supported by `QOI_FORMAT_RGB` to `QOI_FORMAT_ABGR`, `QOI_FORMAT_GRAY8`
+// and `QOI_FORMAT_ALPHA8`.
+#define QOI_FLAG_NORMALIZE (1u << 10)
+// Skip writing pixels whose colour, before any other processing,
+// matches `color_key`. `out_buf` still advances past them, so sprites
+// can be decoded straight onto a framebuffer, and runs of the key
+// colour are skipped in one step. Not supported by the 1-bit formats.
+#define QOI_FLAG_COLOR_KEY (1u << 11)
+// With `QOI_FLAG_COLOR_KEY`, also leave `out_buf` in place for keyed
+// pixels, and return `QOI_STATUS_OPAQUE_SPAN` before each horizontal
+// span of other pixels. The pixels of the span are then written
+// contiguously to `out_buf`.
+#define QOI_FLAG_KEY_SPANS (1u << 12)
+// Report runs of identical pixels with `QOI_STATUS_RUN` instead of
+// writing them, so that they can be drawn as fills. Other pixels are
+// written contiguously to `out_buf` as usual. Only supported by formats
+// of at most 4 bytes per pixel, and not with `QOI_FLAG_PLANAR`,
+// `QOI_FLAG_NORMALIZE`, `QOI_FLAG_BLEND_DEST` or `QOI_FLAG_KEY_SPANS`.
+// Runs of a colour keyed out by `QOI_FLAG_COLOR_KEY` are dropped, and
+// `out_buf` advances past them as for other keyed pixels.
+#define QOI_FLAG_RUNS (1u << 13)
+// For `qoii` interlaced images, fill the block of pixels that each
+// decoded pixel stands for until later passes refine it, and return
+// `QOI_STATUS_PASS_DONE` after each pass but the last, so that a coarse
+// preview can be shown as soon as the first pass has arrived.
+#define QOI_FLAG_PREVIEW (1u << 14)
+
+// Number of bytes by which a buffer must exceed the decoded size of an
+// image for it to be decoded in place: with the `in_size` bytes of the
+// QOI file placed at the end of the buffer and `out_buf` at its start.
+// Output only gains on input through opcodes that are longer than the
+// pixels they produce, by at most `5 - channels` bytes per pixel, and
+// per 5 bytes of opcodes, not counting the 14-byte header and 8-byte
+// tail. The tail is added back, as it is read after the last pixel is
+// written.
+static inline size_t qoi_inplace_margin(const qoi_desc* desc, size_t in_size) {
+  size_t expansion = 5 - desc->channels;
+  size_t pixel_bound = expansion * desc->width * desc->height;
+  size_t opcode_size = (in_size > 14 + 8) ? in_size - 14 - 8 : 0;
+  size_t input_bound = expansion * opcode_size / 5;
+  return (pixel_bound < input_bound ? pixel_bound : input_bound) + 8;
+}
+
+// Output formats for `qoi_stream.format`.
+//
+// `desc.channels` bytes per pixel, in RGB(A) order.
+#define QOI_FORMAT_NATIVE 0
+// Three or four bytes per pixel in the given byte order. The alpha
+// channel is dropped or, for 3-channel images, filled with 255.
+#define QOI_FORMAT_RGB 1
+#define QOI_FORMAT_BGR 2
+#define QOI_FORMAT_RGBA 3
+#define QOI_FORMAT_BGRA 4
+#define QOI_FORMAT_ARGB 5
+#define QOI_FORMAT_ABGR 6
+// One byte of luma per pixel, with BT.601 weights unless
+// `QOI_FLAG_BT709` is set. Alpha is ignored.
+#define QOI_FORMAT_GRAY8 7
+// One bit per pixel, set where the luma is above `threshold`, or above
+// a 4x4 ordered dither pattern with `QOI_FLAG_DITHER`. Bits are packed
+// from the most significant bit, and each row (and each animation
+// span) starts on a new byte.
+#define QOI_FORMAT_MONO1 8
+// The alpha channel alone, as one byte per pixel, or packed one bit
+// per pixel like `QOI_FORMAT_MONO1`. 3-channel images are opaque.
+#define QOI_FORMAT_ALPHA8 9
+#define QOI_FORMAT_ALPHA1 10
+// Two bytes per pixel: a little-endian 16-bit value with red in the
+// top 5 bits, or a big-endian 16-bit value with blue in the top 5 bits
+// as produced by `LCD_rgb24_to_bgr565()`, ready to send to the ST7735.
+#define QOI_FORMAT_RGB565 11
+#define QOI_FORMAT_BGR565 12
+// Linear-light channels in the order and number of the image's own
+// channels, as native-endian 16-bit integers or 32-bit floats in the
+// range [0, 1]. Colour channels of images tagged as sRGB are converted
+// to linear, while alpha and the channels of linear images are only
+// widened.
+#define QOI_FORMAT_LINEAR16 13
+#define QOI_FORMAT_LINEAR32F 14
+// One byte per pixel: the index of the nearest palette colour, looked
+// up in `palette_lut` by the top 4 bits of red, green and blue. Alpha
+// is ignored, so transparent images should be decoded with
+// `QOI_FLAG_BLEND_COLOR`.
+#define QOI_FORMAT_INDEX8 15
+
+// Size of the table used by `QOI_FORMAT_INDEX8`.
+#define QOI_PALETTE_LUT_SIZE 4096
+
+// Fills `lut` for `QOI_FORMAT_INDEX8` with the index of the closest of
+// the `count` (1 to 256) colours in `palette` to the centre of each
+// cell of the table. Colours have red in the least significant byte.
+static inline void qoi_palette_lut(const uint32_t* palette, size_t count,
+                                   uint8_t* lut) {
+  for (unsigned cell = 0; cell < QOI_PALETTE_LUT_SIZE; ++cell) {
+    int r = ((cell >> 8) & 0xF) * 16 + 8;
+    int g = ((cell >> 4) & 0xF) * 16 + 8;
+    int b = (cell & 0xF) * 16 + 8;
+    uint32_t best_distance = UINT32_MAX;
+    for (size_t i = 0; i < count && i < 256; ++i) {
+      int dr = r - (int)(palette[i] & 0xFF);
+      int dg = g - (int)((palette[i] >> 8) & 0xFF);
+      int db = b - (int)((palette[i] >> 16) & 0xFF);
+      uint32_t distance = dr * dr + dg * dg + db * db;
+      if (distance < best_distance) {
+        best_distance = distance;
+        lut[cell] = (uint8_t)i;
+      }
+    }
+  }
+}
+
+// Returns the hash of a pixel, with red in the least significant byte,
+// which modulo 64 gives its slot in `index`.
+static inline uint32_t qoi_pixel_hash(uint32_t c) {
+  return (c & 0xFF) * 3 + ((c >> 8) & 0xFF) * 5 + ((c >> 16) & 0xFF) * 7 +
+         (c >> 24) * 11;
+}
+
+// Fills `dictionary` with the `count` colours in `palette`, each in the
+// `index` slot it is looked up by, so that the first use of any of them
+// is a one-byte `QOI_OP_INDEX`. Of colours that share a slot, the last
+// is kept.
+static inline void qoi_dictionary_init(qoi_dictionary* dictionary,
+                                       const uint32_t* palette,
+                                       size_t count) {
+  memset(dictionary, 0, sizeof(*dictionary));
+  dictionary->px_prev = 0xFF000000;
+  for (size_t i = 0; i < count; ++i)
+    dictionary->index[qoi_pixel_hash(palette[i]) % 64] = palette[i];
+}
+
+// Loads `dictionary` as the starting state of an encoder or decoder.
+// `px_prev` is also stored in its slot, as a leading run would store
+// it in the decoder's `index` but not the encoder's.
+static inline void qoi_dictionary_load(const qoi_dictionary* dictionary,
+                                       uint32_t* px_prev, uint32_t* index) {
+  *px_prev = dictionary->px_prev;
+  memcpy(index, dictionary->index, sizeof(dictionary->index));
+  index[qoi_pixel_hash(*px_prev) % 64] = *px_prev;
+}
+
 // Initializes (or resets) a `qoi_decoder_state`.
 __DECL int __cheri_compartment("qoi_decode")
     qoi_decoder_state_init(qoi_decoder_state* __sealed_capability);
 
 // Return values of `qoi_decode`
+#define QOI_STATUS_ERR_OVERLAP -5
 #define QOI_STATUS_ERR_INTERNAL -4
 #define QOI_STATUS_ERR_PARAM -3
 #define QOI_STATUS_ERR_FORMAT -2
 #define QOI_STATUS_DONE 0
 #define QOI_STATUS_INPUT_EXHAUSTED 1
 #define QOI_STATUS_OUTPUT_EXHAUSTED 2
+#define QOI_STATUS_FRAME_DONE 3
+#define QOI_STATUS_SPAN 4
+// Returned with `QOI_FLAG_KEY_SPANS` before the first pixel of a span
+// of pixels that do not match the colour key. `span.offset` is the
+// index of its first pixel in raster order, and `span.length` the
+// number of pixels left in the row, which the span may not fill.
+#define QOI_STATUS_OPAQUE_SPAN 5
+// Returned with `QOI_FLAG_RUNS` after decoding a run of `span.length`
+// pixels starting at `span.offset`, all equal to `run_color`. The run
+// may cross row boundaries.
+#define QOI_STATUS_RUN 6
+// Returned with `QOI_FLAG_PREVIEW` once each pass of an interlaced
+// image but the last has been written to `out_buf`.
+#define QOI_STATUS_PASS_DONE 7
+
+// Frame type byte of a `qoia` animation frame. `QOI_ANIM_FRAME` is
+// always set; the remaining bits select how the frame is coded.
+#define QOI_ANIM_FRAME 0x80
+// The frame is a sequence of spans, each made of a varint count of
+// pixels unchanged since the previous frame, followed by a varint
+// count of changed pixels and the QOI opcodes encoding them.
+// Otherwise, the frame codes all of its pixels as one span.
+#define QOI_ANIM_FRAME_DELTA 0x01
+// Keep `index` and the previous pixel from the end of the previous
+// frame, rather than resetting them as at the start of an image.
+#define QOI_ANIM_FRAME_CARRY 0x02
+
+// Opcode profiles. `QOI_PROFILE_STANDARD` is plain QOI, as in `qoif`
+// images. `QOI_PROFILE_EXTENDED` is used by `qoix` images, whose header
+// is followed by a `QOI_PROFILE_VERSION` byte. It shortens `QOI_OP_RUN`
+// to runs of 1 to 60 pixels and gives its two longest lengths to
+// `QOI_OP_RUN_LONG` and `QOI_OP_INDEX_BIG`. Its images are usually
+// smaller, but can be larger: besides the version byte, a run of 61 or
+// 62 pixels, one byte in `qoif`, takes two, and one of 121 to 124
+// pixels takes three rather than two. Encode both ways to be sure of
+// the smaller.
+#define QOI_PROFILE_STANDARD 0
+#define QOI_PROFILE_EXTENDED 1
+#define QOI_PROFILE_VERSION 1
+// Followed by a 16-bit big-endian count of the pixels of a run beyond
+// `QOI_RUN_LONG_MIN`.
+#define QOI_OP_RUN_LONG 0xFC
+#define QOI_RUN_LONG_MIN 61
+// Followed by a slot of a second, 256-entry `index`, which is hashed
+// like `index` but modulo 256 and updated with every pixel. It starts
+// empty but for the previous pixel.
+#define QOI_OP_INDEX_BIG 0xFD
+
+// Geometry of a pass of a `qoii` interlaced image: its pixels are
+// those at columns `x + i * dx` and rows `y + j * dy`, coded in raster
+// order. Until the passes after it are decoded, each pixel stands for
+// the `w` by `h` block whose top left corner it is.
+typedef struct {
+  uint8_t x, y, dx, dy, w, h;
+} qoi_interlace_pass;
+
+// The seven Adam7 passes of a `qoii` interlaced image, in order.
+// Defined in `qoi_interlace_passes.cc`, which is built into both
+// `qoi_decode` and `qoi_interlace`.
+#define QOI_INTERLACE_PASSES 7
+__DECL extern const qoi_interlace_pass
+    qoi_interlace_passes[QOI_INTERLACE_PASSES];
 
 // Decodes QOI-formatted data from the given stream.
+//
+// Besides plain `qoif` images, this accepts `qoia` animations: a
+// header laid out like a QOI header but with the `qoia` magic, a
+// sequence of frames, each starting with a `QOI_ANIM_FRAME_*` byte,
+// and the usual 8-byte QOI tail. Animations only produce output for
+// pixels that are coded in the stream. Before each coded span,
+// `QOI_STATUS_SPAN` is returned with its position in `span`, and the
+// span's pixels are then written contiguously to `out_buf`. Each
+// completed frame returns `QOI_STATUS_FRAME_DONE`.
+//
+// It also accepts `qoii` interlaced images: a `qoif` image with the
+// `qoii` magic whose pixels are coded pass by pass, as given by
+// `qoi_interlace_passes`, as one sequence of opcodes. For these,
+// `out_buf` must point to the start of the whole image, with
+// `out_buf_size` covering all of it, and is not advanced: each pixel is
+// written in place. A smaller `out_buf_size` fails with
+// `QOI_STATUS_ERR_PARAM`. They do not support the
+// 1-bit formats, `QOI_FLAG_PLANAR`, `QOI_FLAG_IN_PLACE`,
+// `QOI_FLAG_BLEND_DEST`, `QOI_FLAG_KEY_SPANS` or `QOI_FLAG_RUNS`, which
+// fail with `QOI_STATUS_ERR_PARAM` once the header has been read.
+//
+// Lastly, `qoix` images are decoded like `qoif` images but with the
+// opcodes of `QOI_PROFILE_EXTENDED`.
 __DECL int __cheri_compartment("qoi_decode") qoi_decode(qoi_stream*);
+
+// Initializes the decoder state of `stream` to decode a `qoif` image
+// from `checkpoint` rather than from its header, which is not read.
+// `stream->desc` must be set to the image's description beforehand.
+// The next call to `qoi_decode` then takes the input starting at
+// `checkpoint->offset` bytes into the file, and writes the output of
+// the pixels from `checkpoint->pixel` onwards. A checkpoint that does
+// not start a row leaves the 1-bit formats misaligned. `total_in`,
+// `total_pixels` and `error_offset` count from the start of the file,
+// as if it had been decoded from there. Returns
+// `QOI_STATUS_DONE`, or `QOI_STATUS_ERR_PARAM` if `stream->desc` is
+// invalid or does not contain the checkpoint.
+__DECL int __cheri_compartment("qoi_decode")
+    qoi_decode_resume(qoi_stream*, const qoi_checkpoint*);
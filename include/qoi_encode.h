@@ -0,0 +1,124 @@
+#pragma once
+
+#include <qoi_decode.h>
+
+// A byte-wise streaming QOI encoder, the counterpart of `qoi_decode`.
+// Pixels are consumed and QOI bytes produced in whatever amounts the
+// buffers allow, so an image can be encoded without ever holding all
+// of it in memory. The output is identical to that of the reference
+// encoder.
+
+// Largest number of bytes a QOI encoding of an image can take, as
+// produced by `qoi_encode`, `qoi_encode_host` or `qoi_interlace_encode`.
+// Besides the header, tail and `channels + 1` bytes per pixel, this
+// counts the version byte of `QOI_PROFILE_EXTENDED`, and one byte for a
+// 3-channel image whose dictionary's `px_prev` is not opaque, as its
+// first pixel then needs a 5-byte `QOI_OP_RGBA`.
+#define QOI_ENCODE_SIZE_MAX(desc) \
+  (14 + 1 + 1 + 8 +               \
+   (size_t)(desc)->width * (desc)->height * ((desc)->channels + 1))
+
+// Private internal encoder state.
+typedef struct {
+  uint8_t progress;
+  size_t pixel_length_remaining;
+  uint32_t px_prev;
+  uint32_t index[64];
+  uint32_t run;
+  union {
+    uint32_t v;
+    uint8_t b[4];
+  } px_buf;
+  uint8_t px_buf_size;
+  uint32_t px_raw_prev;
+  uint32_t column;
+  size_t padding_remaining;
+  uint8_t tmp_buf[16];
+  uint8_t tmp_buf_size;
+  uint8_t tmp_buf_pos;
+  size_t total_in;
+  size_t total_out;
+} qoi_encoder_state;
+
+// Can be used to statically define a `qoi_encoder_state` in the
+// calling compartment.
+#define DECLARE_AND_DEFINE_QOI_ENCODER(name)                            \
+  DECLARE_AND_DEFINE_STATIC_SEALED_VALUE(qoi_encoder_state, qoi_encode, \
+                                         QOIEncoderStateKey, name, {})
+
+// Can be used to statically define a `qoi_extended_state` for the
+// encoder in the calling compartment.
+#define DECLARE_AND_DEFINE_QOI_EXTENDED_ENCODER(name)                    \
+  DECLARE_AND_DEFINE_STATIC_SEALED_VALUE(qoi_extended_state, qoi_encode, \
+                                         QOIExtendedStateKey, name, {})
+
+typedef struct {
+  // Points to the next byte of pixel data to be consumed, laid out as
+  // given by `format`.
+  const unsigned char* in_buf;
+  // Number of bytes of input remaining in the buffer.
+  size_t in_buf_size;
+  // Distance in bytes between the starts of successive rows in
+  // `in_buf`, or 0 if they are contiguous. The padding after each row
+  // but the last is skipped, and buffers may end anywhere, including in
+  // the middle of it. The padding after the last row need not be
+  // passed.
+  size_t in_stride;
+
+  // Points to the next byte of output to be written.
+  unsigned char* out_buf;
+  // Number of bytes of output space remaining.
+  size_t out_buf_size;
+
+  // Description of the image to encode. Must be set before the first
+  // call and not changed afterwards.
+  qoi_desc desc;
+
+  // Layout of the pixels in `in_buf`: `QOI_FORMAT_NATIVE` for
+  // `desc.channels` bytes per pixel in RGB(A) order, or, for 3-channel
+  // images, `QOI_FORMAT_RGB565` or `QOI_FORMAT_BGR565`, which are
+  // expanded to 8 bits per channel by bit replication. Must be set
+  // before the first call and not changed afterwards.
+  uint8_t format;
+
+  // Largest error allowed in each of the R, G, B and A channels. Zero
+  // (the default) encodes losslessly. Otherwise each pixel may be
+  // replaced by any within these bounds that is cheaper to encode, such
+  // as the previous pixel, to extend a run. The result still decodes
+  // with `qoi_decode`. Must not be changed while an image is being
+  // encoded.
+  uint8_t tolerance[4];
+
+  // Optional preset dictionary to start the image from, which must
+  // also be passed to the decoder. Must be set before the first call.
+  const qoi_dictionary* dictionary;
+
+  // Opcode profile to encode with: `QOI_PROFILE_STANDARD` (the default)
+  // for a `qoif` image, or `QOI_PROFILE_EXTENDED` for a `qoix` image
+  // with long runs and a big index. Must be set before the first call.
+  uint8_t profile;
+
+  // Number of input bytes consumed and output bytes produced since the
+  // encoder was initialized. Updated on every return.
+  size_t total_in;
+  size_t total_out;
+
+  // Private internal encoder state.
+  qoi_encoder_state* __sealed_capability encoder_state;
+  // Private internal state for `QOI_PROFILE_EXTENDED`, without which
+  // that profile fails with `QOI_STATUS_ERR_PARAM`. Must be set before
+  // the first call and not changed afterwards.
+  qoi_extended_state* __sealed_capability extended_state;
+} qoi_encode_stream;
+
+// Initializes (or resets) a `qoi_encoder_state`.
+__DECL int __cheri_compartment("qoi_encode")
+    qoi_encoder_state_init(qoi_encoder_state* __sealed_capability);
+
+// Encodes pixels from the given stream as a QOI image, using the
+// `QOI_STATUS_*` values of `qoi_decode`. `QOI_STATUS_INPUT_EXHAUSTED`
+// asks for more pixel data and `QOI_STATUS_OUTPUT_EXHAUSTED` for more
+// output space; either may be returned at any byte boundary. Once the
+// tail has been written, `QOI_STATUS_DONE` is returned. An invalid
+// `desc`, `format` or `profile` fails with `QOI_STATUS_ERR_PARAM`.
+__DECL int __cheri_compartment("qoi_encode") qoi_encode(qoi_encode_stream*);
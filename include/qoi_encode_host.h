@@ -0,0 +1,29 @@
+#pragma once
+
+#include <qoi_encode.h>
+
+// Whole-image QOI encoder for host builds, such as asset pipelines.
+// Where AVX2 is available, runs, small differences and index hashes are
+// classified eight pixels at a time, leaving only the `index` lookups
+// and run counting serial. The output is identical to that of
+// `qoi_encode` and the reference encoder.
+
+// Encodes an image of `desc->channels` bytes per pixel into `out`,
+// which must have room for `QOI_ENCODE_SIZE_MAX(desc)` bytes. Returns
+// the number of bytes written, or 0 if `desc` or `out_size` is invalid.
+__DECL size_t qoi_encode_host(const qoi_desc* desc,
+                              const unsigned char* pixels, unsigned char* out,
+                              size_t out_size);
+
+// Encodes an image like `qoi_encode_host`, with the same output, but
+// splits it into `bands` horizontal bands encoded on up to `threads`
+// threads (0 for one per core). Each band starts without knowing the
+// `index` left by those above it, and is fixed up once they are done.
+// If `checkpoints` is not null, it receives one checkpoint for the start
+// of each band, from which `qoi_decode_resume` can start decoding.
+// `bands` greater than `desc->height` is reduced to one band per row.
+__DECL size_t qoi_encode_host_parallel(const qoi_desc* desc,
+                                       const unsigned char* pixels,
+                                       unsigned char* out, size_t out_size,
+                                       uint32_t bands, uint32_t threads,
+                                       qoi_checkpoint* checkpoints);
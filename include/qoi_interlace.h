@@ -0,0 +1,18 @@
+#pragma once
+
+#include <qoi_encode.h>
+#include <stddef.h>
+
+// Encoder for `qoii` interlaced images, as decoded by `qoi_decode`.
+// The pixels of each of the `qoi_interlace_passes` are coded in turn,
+// so that a decoder with `QOI_FLAG_PREVIEW` can show the whole image
+// at one sixty-fourth of its resolution once the first pass arrives.
+
+// Encodes an image of `desc->channels` bytes per pixel as a `qoii`
+// interlaced image, into `out`, which needs room for at most
+// `QOI_ENCODE_SIZE_MAX(desc)` bytes. Returns the number of bytes
+// written, 0 if `out_size` is too small, or `QOI_STATUS_ERR_PARAM` for
+// a `desc` that `qoi_encode` would not accept.
+__DECL ptrdiff_t __cheri_libcall
+qoi_interlace_encode(const qoi_desc* desc, const unsigned char* pixels,
+                     unsigned char* out, size_t out_size);
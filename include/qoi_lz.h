@@ -0,0 +1,69 @@
+#pragma once
+
+#include <qoi_decode.h>
+
+// Streaming decompressor for `qoiz` files: QOI data, of any kind that
+// `qoi_decode` accepts, compressed with a small LZ77 window to remove
+// repeats that QOI leaves, such as tiles and repeated rows. It runs in
+// front of `qoi_decode`, feeding it straight from the window, so both
+// stages run in one pass with no buffer beyond the window itself.
+//
+// After the `qoiz` magic, the data is a sequence of elements, each
+// starting with a control byte:
+//
+// - `0LLLLLLL`: `L + 1` literal bytes follow.
+// - `1LLLOOOO OOOOOOOO`: a copy of earlier bytes, `O + 1` bytes back,
+//   of `L + 3` bytes if `L` is below 7, or otherwise of `10 + E` bytes
+//   where `E` is one more byte.
+//
+// There is no end marker; the QOI data ends with its own tail.
+
+// Size of the window, which limits how far back copies can reach.
+#define QOI_LZ_WINDOW_SIZE 4096
+
+// State of a `qoiz` decompressor. Only `in_buf`, `in_buf_size` and
+// `total_in` are public.
+typedef struct {
+  // Points to the next byte of compressed input to be consumed.
+  const unsigned char* in_buf;
+  // Number of bytes of compressed input remaining in the buffer.
+  size_t in_buf_size;
+  // Number of compressed bytes consumed since `qoi_lz_init`.
+  size_t total_in;
+
+  uint8_t progress;
+  uint8_t control;
+  uint16_t offset;
+  uint16_t length;
+  // Bytes of decompressed data produced, and passed on to `qoi_decode`.
+  size_t produced;
+  size_t consumed;
+  unsigned char window[QOI_LZ_WINDOW_SIZE];
+} qoi_lz_decoder;
+
+// Initializes (or resets) `lz`, leaving its input empty.
+__DECL void __cheri_libcall qoi_lz_init(qoi_lz_decoder* lz);
+
+// Decompresses input from `lz` and decodes it with `qoi_decode` on
+// `stream`, whose `in_buf` and `in_buf_size` are managed by this call.
+// Returns as `qoi_decode` does, except that `QOI_STATUS_INPUT_EXHAUSTED`
+// asks for more compressed input in `lz`, and that a malformed `qoiz`
+// layer fails with `QOI_STATUS_ERR_FORMAT`. `stream->total_in` and
+// `error_offset` count decompressed bytes. Not supported with
+// `QOI_FLAG_IN_PLACE`.
+__DECL int __cheri_libcall qoi_lz_decode(qoi_lz_decoder* lz,
+                                         qoi_stream* stream);
+
+#ifndef __CHERIOT__
+// Largest number of bytes `qoi_lz_compress` can produce for `size`
+// bytes of input.
+#define QOI_LZ_SIZE_MAX(size) \
+  (4 + (size_t)(size) + ((size_t)(size) + 127) / 128)
+
+// Compresses the QOI data in `in` into a `qoiz` file, into `out`, which
+// must have room for `QOI_LZ_SIZE_MAX(in_size)` bytes. Returns the
+// number of bytes written, or 0 if `out_size` is too small. Only built
+// for the host, for asset pipelines.
+size_t qoi_lz_compress(const unsigned char* in, size_t in_size,
+                       unsigned char* out, size_t out_size);
+#endif
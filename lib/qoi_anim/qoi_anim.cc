@@ -0,0 +1,131 @@
+#include <qoi_anim.h>
+
+#include "../qoi_encode/qoi_encode_ops.h"
+
+static constexpr uint8_t qoi_anim_magic[4] = {'q', 'o', 'i', 'a'};
+static constexpr uint8_t qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+static constexpr size_t QOI_PIXELS_MAX = 400000000;
+
+// Largest number of bytes in a varint holding a 32-bit value.
+static constexpr size_t QOI_VARINT_SIZE_MAX = 5;
+
+static size_t qoi_write_varint(unsigned char *out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = 0x80 | (value & 0x7F);
+    value >>= 7;
+  }
+  out[n++] = value;
+  return n;
+}
+
+static uint32_t qoi_read_pixel(const unsigned char *pixels, size_t i,
+                               uint8_t channels) {
+  uint32_t pixel = 0xFF000000;
+  memcpy(&pixel, pixels + i * channels, channels);
+  return pixel;
+}
+
+static bool qoi_pixel_unchanged(const unsigned char *pixels,
+                                const unsigned char *prev_pixels, size_t i,
+                                uint8_t channels) {
+  return !memcmp(pixels + i * channels, prev_pixels + i * channels, channels);
+}
+
+ptrdiff_t qoi_anim_encode_header(qoi_anim_encoder *encoder,
+                                 const qoi_desc *desc, unsigned char *out,
+                                 size_t out_size) {
+  if (desc->width == 0 || desc->height == 0 ||
+      desc->height >= QOI_PIXELS_MAX / desc->width ||
+      (desc->channels != 3 && desc->channels != 4) ||
+      (desc->colorspace != 0 && desc->colorspace != 4))
+    return QOI_STATUS_ERR_PARAM;
+  if (out_size < QOI_ANIM_HEADER_SIZE) return 0;
+
+  encoder->desc = *desc;
+  encoder->px_prev = 0xFF000000;
+  memset(encoder->index, 0, sizeof(encoder->index));
+
+  uint32_t width = __builtin_bswap32(desc->width);
+  uint32_t height = __builtin_bswap32(desc->height);
+  memcpy(out, qoi_anim_magic, 4);
+  memcpy(out + 4, &width, 4);
+  memcpy(out + 8, &height, 4);
+  out[12] = desc->channels;
+  out[13] = desc->colorspace;
+  return QOI_ANIM_HEADER_SIZE;
+}
+
+size_t qoi_anim_encode_frame(qoi_anim_encoder *encoder,
+                             const unsigned char *pixels,
+                             const unsigned char *prev_pixels,
+                             uint8_t frame_flags, unsigned char *out,
+                             size_t out_size) {
+  const uint8_t channels = encoder->desc.channels;
+  const size_t length = encoder->desc.width * encoder->desc.height;
+
+  // Work on a copy of the opcode state so that a failed frame leaves
+  // the encoder untouched.
+  qoi_ops_state ops;
+  qoi_ops_init(&ops);
+  if (frame_flags & QOI_ANIM_FRAME_CARRY) {
+    ops.px_prev = encoder->px_prev;
+    memcpy(ops.index, encoder->index, sizeof(ops.index));
+  } else if (encoder->dictionary) {
+    qoi_dictionary_load(encoder->dictionary, &ops.px_prev, ops.index);
+  }
+
+  if (out_size < 1) return 0;
+  size_t n = 0;
+  out[n++] = QOI_ANIM_FRAME | (frame_flags & QOI_ANIM_FRAME_CARRY) |
+             (prev_pixels ? QOI_ANIM_FRAME_DELTA : 0);
+
+  size_t i = 0;
+  while (i < length) {
+    size_t start = i;
+    size_t end = length;
+
+    if (prev_pixels) {
+      // Skip over unchanged pixels, then extend the span until the
+      // next gap of at least `QOI_ANIM_MIN_SKIP` unchanged pixels.
+      while (start < length &&
+             qoi_pixel_unchanged(pixels, prev_pixels, start, channels))
+        start += 1;
+
+      end = start;
+      for (size_t j = start; j < length; ++j) {
+        if (!qoi_pixel_unchanged(pixels, prev_pixels, j, channels)) {
+          end = j + 1;
+        } else if (j - end + 1 >= QOI_ANIM_MIN_SKIP) {
+          break;
+        }
+      }
+
+      if (out_size - n < 2 * QOI_VARINT_SIZE_MAX) return 0;
+      n += qoi_write_varint(out + n, start - i);
+      n += qoi_write_varint(out + n, end - start);
+    }
+
+    for (size_t j = start; j < end; ++j) {
+      if (out_size - n < QOI_OPS_PIXEL_SIZE_MAX) return 0;
+      n += qoi_ops_push(&ops, qoi_read_pixel(pixels, j, channels), out + n);
+    }
+
+    // Runs may not extend past the end of a span.
+    if (out_size - n < 1) return 0;
+    n += qoi_ops_flush_run(&ops, out + n);
+
+    i = end;
+  }
+
+  encoder->px_prev = ops.px_prev;
+  memcpy(encoder->index, ops.index, sizeof(encoder->index));
+  return n;
+}
+
+size_t qoi_anim_encode_tail(unsigned char *out, size_t out_size) {
+  if (out_size < QOI_ANIM_TAIL_SIZE) return 0;
+  memcpy(out, qoi_padding, QOI_ANIM_TAIL_SIZE);
+  return QOI_ANIM_TAIL_SIZE;
+}
@@ -0,0 +1,5 @@
+library("qoi_anim")
+    set_default(false)
+    add_includedirs("../../include")
+    add_deps("freestanding")
+    add_files("qoi_anim.cc")
@@ -7,9 +7,22 @@
 using Debug = ConditionalDebug<true, "QOI Decoder">;
 #endif
 
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static constexpr size_t QOI_PIXELS_MAX = 400000000;
 
 static constexpr uint8_t qoi_magic[4] = {'q', 'o', 'i', 'f'};
+static constexpr uint8_t qoi_anim_magic[4] = {'q', 'o', 'i', 'a'};
+static constexpr uint8_t qoi_interlace_magic[4] = {'q', 'o', 'i', 'i'};
+static constexpr uint8_t qoi_extended_magic[4] = {'q', 'o', 'i', 'x'};
 static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
 
 #ifdef __CHERIOT__
@@ -17,6 +30,11 @@ static qoi_decoder_state *qoi_unseal(
     qoi_decoder_state *__sealed_capability sealed) {
   return token_unseal(STATIC_SEALING_TYPE(QOIDecoderStateKey), sealed);
 }
+
+static qoi_extended_state *qoi_unseal(
+    qoi_extended_state *__sealed_capability sealed) {
+  return token_unseal(STATIC_SEALING_TYPE(QOIExtendedStateKey), sealed);
+}
 #else
 // Provide a no-op implementation of unsealing when building for
 // non-CHERIoT.
@@ -24,6 +42,11 @@ static qoi_decoder_state *qoi_unseal(
     qoi_decoder_state *__sealed_capability sealed) {
   return sealed;
 }
+
+static qoi_extended_state *qoi_unseal(
+    qoi_extended_state *__sealed_capability sealed) {
+  return sealed;
+}
 #endif
 
 int qoi_decoder_state_init(
@@ -48,7 +71,20 @@ static constexpr uint8_t QOI_PROGRESS_NEW_PIXEL = 5;
 static constexpr uint8_t QOI_PROGRESS_OP_RGBA = 6;
 static constexpr uint8_t QOI_PROGRESS_BUFFERED_OUTPUT = 7;
 static constexpr uint8_t QOI_PROGRESS_AWAIT_TAIL = 8;
-static constexpr uint8_t QOI_PROGRESS_INVALID = 9;
+static constexpr uint8_t QOI_PROGRESS_ANIM_FRAME = 9;
+static constexpr uint8_t QOI_PROGRESS_ANIM_SKIP = 10;
+static constexpr uint8_t QOI_PROGRESS_ANIM_COUNT = 11;
+static constexpr uint8_t QOI_PROGRESS_VALIDATE = 12;
+static constexpr uint8_t QOI_PROGRESS_PIXEL_DONE = 13;
+static constexpr uint8_t QOI_PROGRESS_DONE = 14;
+static constexpr uint8_t QOI_PROGRESS_INVALID = 15;
+static constexpr uint8_t QOI_PROGRESS_AWAIT_VERSION = 16;
+
+// The `QOI_CONTAINER_*` constants identify the kind of stream being
+// decoded, as selected by its magic constant.
+static constexpr uint8_t QOI_CONTAINER_IMAGE = 0;
+static constexpr uint8_t QOI_CONTAINER_ANIM = 1;
+static constexpr uint8_t QOI_CONTAINER_INTERLACED = 2;
 
 // Shift bytes from the input buffer into the decoder's internal buffer.
 static void qoi_shift_bytes(qoi_decoder_state *decoder, qoi_stream *stream,
@@ -70,28 +106,542 @@ static int qoi_progress_await_width(qoi_decoder_state *, qoi_stream *);
 static int qoi_progress_await_height(qoi_decoder_state *, qoi_stream *);
 static int qoi_progress_await_channels(qoi_decoder_state *, qoi_stream *);
 static int qoi_progress_await_colorspace(qoi_decoder_state *, qoi_stream *);
+static int qoi_progress_await_version(qoi_decoder_state *, qoi_stream *);
 static int qoi_progress_new_pixel(qoi_decoder_state *, qoi_stream *);
 static int qoi_progress_op_rgba(qoi_decoder_state *, qoi_stream *);
 static int qoi_progress_buffered_output(qoi_decoder_state *, qoi_stream *);
 static int qoi_progress_await_tail(qoi_decoder_state *, qoi_stream *);
+static int qoi_progress_anim_frame(qoi_decoder_state *, qoi_stream *);
+static int qoi_progress_anim_skip(qoi_decoder_state *, qoi_stream *);
+static int qoi_progress_anim_count(qoi_decoder_state *, qoi_stream *);
+static int qoi_progress_validate(qoi_decoder_state *, qoi_stream *);
+static int qoi_progress_pixel_done(qoi_decoder_state *, qoi_stream *);
+static int qoi_progress_done(qoi_decoder_state *, qoi_stream *);
+static int qoi_anim_span_done(qoi_decoder_state *, qoi_stream *);
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+// Lookup table for the bytewise CRC32C fallback, used where there are
+// no CRC instructions.
+struct qoi_crc32c_table {
+  uint32_t v[256];
+};
+
+static constexpr qoi_crc32c_table qoi_crc32c_make_table() {
+  qoi_crc32c_table table = {};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit)
+      crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+    table.v[i] = crc;
+  }
+  return table;
+}
 
-// Shared helper for writing a pixel, including updating the `index` array.
-static int qoi_output_pixel(qoi_decoder_state *decoder, qoi_stream *stream,
+static constexpr qoi_crc32c_table qoi_crc32c = qoi_crc32c_make_table();
+#endif
+
+// Updates a running CRC32C with the first `channels` bytes of `pixel`.
+static uint32_t qoi_crc32c_pixel(uint32_t crc, uint32_t pixel,
+                                 uint8_t channels) {
+#if defined(__SSE4_2__)
+  if (channels == 4) return _mm_crc32_u32(crc, pixel);
+  crc = _mm_crc32_u16(crc, uint16_t(pixel));
+  return _mm_crc32_u8(crc, uint8_t(pixel >> 16));
+#elif defined(__ARM_FEATURE_CRC32)
+  if (channels == 4) return __crc32cw(crc, pixel);
+  crc = __crc32ch(crc, uint16_t(pixel));
+  return __crc32cb(crc, uint8_t(pixel >> 16));
+#else
+  for (uint8_t i = 0; i < channels; ++i, pixel >>= 8)
+    crc = (crc >> 8) ^ qoi_crc32c.v[(crc ^ pixel) & 0xFF];
+  return crc;
+#endif
+}
+
+// Number of `QOI_FORMAT_*` values.
+static constexpr uint8_t QOI_FORMAT_COUNT = QOI_FORMAT_INDEX8 + 1;
+
+// Whether a format has a single luma or alpha channel per pixel.
+static bool qoi_format_is_single(uint8_t format) {
+  return format >= QOI_FORMAT_GRAY8 && format <= QOI_FORMAT_ALPHA1;
+}
+
+// Number of 8-bit channels in the formats that support
+// `QOI_FLAG_PLANAR` or `QOI_FLAG_NORMALIZE`, or 0 for other formats.
+static uint8_t qoi_format_channels(uint8_t format) {
+  switch (format) {
+    case QOI_FORMAT_RGB:
+    case QOI_FORMAT_BGR:
+      return 3;
+    case QOI_FORMAT_RGBA:
+    case QOI_FORMAT_BGRA:
+    case QOI_FORMAT_ARGB:
+    case QOI_FORMAT_ABGR:
+      return 4;
+    case QOI_FORMAT_GRAY8:
+    case QOI_FORMAT_ALPHA8:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+// Position of the alpha byte within an output pixel, or -1 if there is
+// none.
+static int qoi_format_alpha_byte(uint8_t format, uint8_t channels) {
+  switch (format) {
+    case QOI_FORMAT_NATIVE:
+      return (channels == 4) ? 3 : -1;
+    case QOI_FORMAT_RGBA:
+    case QOI_FORMAT_BGRA:
+      return 3;
+    case QOI_FORMAT_ARGB:
+    case QOI_FORMAT_ABGR:
+    case QOI_FORMAT_ALPHA8:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+// Divides by 255 with rounding, for values up to 255 * 255.
+static uint32_t qoi_div255(uint32_t x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+// Applies the lookup tables in `stream->lut` to a decoded pixel.
+static uint32_t qoi_lut_pixel(qoi_stream *stream, uint32_t pixel) {
+  const uint8_t *lut = stream->lut;
+  uint32_t out = lut[pixel & 0xFF] | lut[256 + ((pixel >> 8) & 0xFF)] << 8 |
+                 lut[512 + ((pixel >> 16) & 0xFF)] << 16;
+  uint32_t alpha = pixel >> 24;
+  if (stream->lut_size == 1024 && stream->desc.channels == 4)
+    alpha = lut[768 + alpha];
+  return out | (alpha << 24);
+}
+
+// Applies `QOI_FLAG_PREMULTIPLY` and `QOI_FLAG_BLEND_COLOR` to a
+// decoded pixel.
+static uint32_t qoi_compose_pixel(qoi_stream *stream, uint32_t pixel) {
+  uint32_t alpha = (stream->desc.channels == 3) ? 0xFF : pixel >> 24;
+  uint32_t out = 0;
+  for (int shift = 0; shift < 24; shift += 8) {
+    uint32_t c = (pixel >> shift) & 0xFF;
+    if (stream->flags & QOI_FLAG_BLEND_COLOR) {
+      uint32_t bg = (stream->background >> shift) & 0xFF;
+      c = qoi_div255(c * alpha + bg * (0xFF - alpha));
+    } else {
+      c = qoi_div255(c * alpha);
+    }
+    out |= c << shift;
+  }
+  if (stream->flags & QOI_FLAG_BLEND_COLOR) alpha = 0xFF;
+  return out | (alpha << 24);
+}
+
+// Thresholds of the 4x4 ordered dither used by 1-bit formats.
+static constexpr uint8_t qoi_dither[4][4] = {
+    {8, 136, 40, 168},
+    {200, 72, 232, 104},
+    {56, 184, 24, 152},
+    {248, 120, 216, 88},
+};
+
+// Converts a decoded pixel into the requested output format, storing
+// it in `*out` in output byte order and returning its size in bytes.
+static uint8_t qoi_format_pixel(uint8_t format, uint8_t channels,
+                                uint32_t pixel, uint32_t *out) {
+  if (format == QOI_FORMAT_NATIVE) {
+    *out = pixel;
+    return channels;
+  }
+
+  // Images with 3 channels are always opaque.
+  if (channels == 3) pixel |= 0xFF000000;
+
+  uint32_t swapped = (pixel & 0xFF00FF00) | ((pixel & 0xFF) << 16) |
+                     ((pixel >> 16) & 0xFF);
+  switch (format) {
+    case QOI_FORMAT_RGB:
+      *out = pixel & 0xFFFFFF;
+      return 3;
+    case QOI_FORMAT_BGR:
+      *out = swapped & 0xFFFFFF;
+      return 3;
+    case QOI_FORMAT_RGBA:
+      *out = pixel;
+      return 4;
+    case QOI_FORMAT_BGRA:
+      *out = swapped;
+      return 4;
+    case QOI_FORMAT_ARGB:
+      *out = (pixel << 8) | (pixel >> 24);
+      return 4;
+    case QOI_FORMAT_ABGR:
+      *out = __builtin_bswap32(pixel);
+      return 4;
+    case QOI_FORMAT_RGB565:
+      *out = (pixel & 0xF8) << 8 | (pixel & 0xFC00) >> 5 |
+             (pixel & 0xF80000) >> 19;
+      return 2;
+    case QOI_FORMAT_BGR565:
+    default:
+      *out = __builtin_bswap16((pixel & 0xF80000) >> 8 |
+                               (pixel & 0xFC00) >> 5 | (pixel & 0xF8) >> 3);
+      return 2;
+  }
+}
+
+// Linear light for each sRGB-encoded 8-bit value, scaled to 16 bits.
+static constexpr uint16_t qoi_srgb_to_linear[256] = {
+    0, 20, 40, 60, 80, 99, 119, 139, 159, 179, 199, 219, 241, 264, 288, 313,
+    340, 367, 396, 427, 458, 491, 526, 562, 599, 637, 677, 718, 761, 805, 851,
+    898, 947, 997, 1048, 1101, 1156, 1212, 1270, 1330, 1391, 1453, 1517, 1583,
+    1651, 1720, 1790, 1863, 1937, 2013, 2090, 2170, 2250, 2333, 2418, 2504,
+    2592, 2681, 2773, 2866, 2961, 3058, 3157, 3258, 3360, 3464, 3570, 3678,
+    3788, 3900, 4014, 4129, 4247, 4366, 4488, 4611, 4736, 4864, 4993, 5124,
+    5257, 5392, 5530, 5669, 5810, 5953, 6099, 6246, 6395, 6547, 6700, 6856,
+    7014, 7174, 7335, 7500, 7666, 7834, 8004, 8177, 8352, 8528, 8708, 8889,
+    9072, 9258, 9445, 9635, 9828, 10022, 10219, 10417, 10619, 10822, 11028,
+    11235, 11446, 11658, 11873, 12090, 12309, 12530, 12754, 12980, 13209, 13440,
+    13673, 13909, 14146, 14387, 14629, 14874, 15122, 15371, 15623, 15878, 16135,
+    16394, 16656, 16920, 17187, 17456, 17727, 18001, 18277, 18556, 18837, 19121,
+    19407, 19696, 19987, 20281, 20577, 20876, 21177, 21481, 21787, 22096, 22407,
+    22721, 23038, 23357, 23678, 24002, 24329, 24658, 24990, 25325, 25662, 26001,
+    26344, 26688, 27036, 27386, 27739, 28094, 28452, 28813, 29176, 29542, 29911,
+    30282, 30656, 31033, 31412, 31794, 32179, 32567, 32957, 33350, 33745, 34143,
+    34544, 34948, 35355, 35764, 36176, 36591, 37008, 37429, 37852, 38278, 38706,
+    39138, 39572, 40009, 40449, 40891, 41337, 41785, 42236, 42690, 43147, 43606,
+    44069, 44534, 45002, 45473, 45947, 46423, 46903, 47385, 47871, 48359, 48850,
+    49344, 49841, 50341, 50844, 51349, 51858, 52369, 52884, 53401, 53921, 54445,
+    54971, 55500, 56032, 56567, 57105, 57646, 58190, 58737, 59287, 59840, 60396,
+    60955, 61517, 62082, 62650, 63221, 63795, 64372, 64952, 65535,
+};
+
+// Writes a pixel in `QOI_FORMAT_LINEAR16` or `QOI_FORMAT_LINEAR32F` to
+// `out`, which must have space for 16 bytes. Returns the number of
+// bytes written.
+static uint8_t qoi_format_linear(uint8_t format, const qoi_desc *desc,
+                                 uint32_t pixel, uint8_t *out) {
+  uint32_t c[4];
+  for (int i = 0; i < 4; ++i) {
+    uint32_t v = (pixel >> (8 * i)) & 0xFF;
+    c[i] = (i < 3 && desc->colorspace == 0) ? qoi_srgb_to_linear[v]
+                                            : v * 0x101;
+  }
+
+  if (format == QOI_FORMAT_LINEAR16) {
+    uint16_t h[4] = {uint16_t(c[0]), uint16_t(c[1]), uint16_t(c[2]),
+                     uint16_t(c[3])};
+    memcpy(out, h, sizeof(h));
+    return desc->channels * sizeof(uint16_t);
+  }
+
+  float f[4];
+  for (int i = 0; i < 4; ++i) f[i] = float(c[i]) * (1.0f / 65535);
+  memcpy(out, f, sizeof(f));
+  return desc->channels * sizeof(float);
+}
+
+// Returns the palette entry for a pixel in `QOI_FORMAT_INDEX8`. The
+// entry is cached for each slot of the index, so that pixels coming
+// from `QOI_OP_INDEX` (or otherwise matching their slot) skip the
+// table lookup.
+static uint8_t qoi_format_index(qoi_decoder_state *decoder,
+                                qoi_stream *stream, size_t slot,
+                                uint32_t pixel, uint32_t out_pixel) {
+  const uint64_t slot_bit = uint64_t(1) << slot;
+  if ((decoder->palette_valid & slot_bit) && decoder->index[slot] == pixel)
+    return decoder->palette_slot[slot];
+
+  uint8_t entry = stream->palette_lut[(out_pixel & 0xF0) << 4 |
+                                      ((out_pixel >> 8) & 0xF0) |
+                                      ((out_pixel >> 20) & 0x0F)];
+  decoder->palette_slot[slot] = entry;
+  decoder->palette_valid |= slot_bit;
+  return entry;
+}
+
+// Replaces the staged 8-bit channels with the floats produced by
+// `QOI_FLAG_NORMALIZE`.
+static void qoi_normalize(qoi_decoder_state *decoder, qoi_stream *stream) {
+  const uint8_t channels = decoder->tmp_buf_size;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v = _mm_cvtsi32_si128(decoder->tmp_buf.v);
+  v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+  __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_loadu_ps(stream->scale));
+  _mm_storeu_ps(reinterpret_cast<float *>(decoder->tmp_buf.b),
+                _mm_add_ps(f, _mm_loadu_ps(stream->bias)));
+#else
+  float f[4];
+  for (int i = 0; i < channels; ++i)
+    f[i] = decoder->tmp_buf.b[i] * stream->scale[i] + stream->bias[i];
+  memcpy(decoder->tmp_buf.b, f, channels * sizeof(float));
+#endif
+  decoder->tmp_buf_size = channels * sizeof(float);
+}
+
+// Splits a `QOI_FORMAT_RGB565` or `QOI_FORMAT_BGR565` pixel into its
+// red, green and blue fields, or packs them back together.
+static void qoi_unpack_565(uint8_t format, uint16_t v, uint32_t c[3]) {
+  if (format == QOI_FORMAT_BGR565) {
+    v = __builtin_bswap16(v);
+    c[0] = v & 0x1F;
+    c[2] = v >> 11;
+  } else {
+    c[0] = v >> 11;
+    c[2] = v & 0x1F;
+  }
+  c[1] = (v >> 5) & 0x3F;
+}
+
+static uint16_t qoi_pack_565(uint8_t format, const uint32_t c[3]) {
+  if (format == QOI_FORMAT_BGR565)
+    return __builtin_bswap16(c[2] << 11 | c[1] << 5 | c[0]);
+  return c[0] << 11 | c[1] << 5 | c[2];
+}
+
+// Writes the staged output pixel over the one in `out_buf` for
+// `QOI_FLAG_BLEND_DEST`.
+static void qoi_blend_dest(qoi_decoder_state *decoder, qoi_stream *stream) {
+  const uint32_t alpha = decoder->alpha;
+  const uint8_t size = decoder->tmp_buf_size;
+  unsigned char *out = stream->out_buf;
+
+  // Transparent pixels leave the destination untouched, and opaque
+  // ones replace it without reading it.
+  if (alpha == 0) return;
+  if (alpha == 0xFF) {
+    memcpy(out, &decoder->tmp_buf, size);
+    return;
+  }
+
+  const bool premultiplied = stream->flags & QOI_FLAG_PREMULTIPLY;
+  if (stream->format == QOI_FORMAT_RGB565 ||
+      stream->format == QOI_FORMAT_BGR565) {
+    uint16_t dst_v;
+    memcpy(&dst_v, out, 2);
+    uint32_t src[3], dst[3];
+    qoi_unpack_565(stream->format, decoder->tmp_buf.v, src);
+    qoi_unpack_565(stream->format, dst_v, dst);
+    for (int i = 0; i < 3; ++i) {
+      uint32_t max = (i == 1) ? 0x3F : 0x1F;
+      uint32_t c = premultiplied
+                       ? src[i] + qoi_div255(dst[i] * (0xFF - alpha))
+                       : qoi_div255(src[i] * alpha + dst[i] * (0xFF - alpha));
+      src[i] = (c > max) ? max : c;
+    }
+    dst_v = qoi_pack_565(stream->format, src);
+    memcpy(out, &dst_v, 2);
+    return;
+  }
+
+  // Colour bytes use the straight or premultiplied "over" operator,
+  // while alpha is always combined as `a + d * (1 - a)`.
+  int alpha_byte = qoi_format_alpha_byte(stream->format, stream->desc.channels);
+  for (int i = 0; i < size; ++i) {
+    uint32_t src = decoder->tmp_buf.b[i];
+    uint32_t dst = out[i];
+    uint32_t c = (premultiplied || i == alpha_byte)
+                     ? src + qoi_div255(dst * (0xFF - alpha))
+                     : qoi_div255(src * alpha + dst * (0xFF - alpha));
+    out[i] = (c > 0xFF) ? 0xFF : c;
+  }
+}
+
+// Integer luma of a pixel, with weights summing to 256.
+static uint8_t qoi_luma(uint32_t pixel, bool bt709) {
+  uint32_t r = pixel & 0xFF;
+  uint32_t g = (pixel >> 8) & 0xFF;
+  uint32_t b = (pixel >> 16) & 0xFF;
+  if (bt709) return (54 * r + 183 * g + 19 * b + 128) >> 8;
+  return (77 * r + 150 * g + 29 * b + 128) >> 8;
+}
+
+// Stages the output for the single-channel luma and alpha formats.
+// The luma of the previous pixel is kept, so that it is not
+// recomputed for runs.
+static void qoi_format_single(qoi_decoder_state *decoder, qoi_stream *stream,
+                              uint32_t pixel, bool repeat) {
+  uint8_t value;
+  if (stream->format == QOI_FORMAT_GRAY8 ||
+      stream->format == QOI_FORMAT_MONO1) {
+    if (!repeat)
+      decoder->luma_prev = qoi_luma(pixel, stream->flags & QOI_FLAG_BT709);
+    value = decoder->luma_prev;
+  } else {
+    value = (stream->desc.channels == 3) ? 0xFF : pixel >> 24;
+  }
+
+  if (stream->format == QOI_FORMAT_GRAY8 ||
+      stream->format == QOI_FORMAT_ALPHA8) {
+    decoder->tmp_buf.v = value;
+    decoder->tmp_buf_size = 1;
+    return;
+  }
+
+  uint8_t threshold = stream->threshold;
+  if (stream->flags & QOI_FLAG_DITHER)
+    threshold = qoi_dither[decoder->row & 3][decoder->column & 3];
+  decoder->bits = (decoder->bits << 1) | (value > threshold);
+  decoder->bit_count += 1;
+
+  // Emit a byte once it is full, or at the end of a row or span.
+  bool row_end = decoder->column + 1 == stream->desc.width;
+  bool span_end = decoder->container == QOI_CONTAINER_ANIM &&
+                  decoder->span_remaining == 1;
+  if (decoder->bit_count == 8 || row_end || span_end) {
+    decoder->tmp_buf.v = uint8_t(decoder->bits << (8 - decoder->bit_count));
+    decoder->tmp_buf_size = 1;
+    decoder->bits = 0;
+    decoder->bit_count = 0;
+  } else {
+    decoder->tmp_buf_size = 0;
+  }
+}
+
+// Converts a decoded pixel into `tmp_buf` in the output format and
+// records it as the previous pixel and in the index.
+static void qoi_stage_pixel(qoi_decoder_state *decoder, qoi_stream *stream,
                             uint32_t pixel) {
-  decoder->tmp_buf.v = pixel;
-  decoder->tmp_buf_size = stream->desc.channels;
-  decoder->px_prev = pixel;
+  const size_t hash = qoi_pixel_hash(pixel);
+  const size_t pixel_idx = hash % 64;
 
-  uint8_t pixel_channels[4];
-  memcpy(pixel_channels, &pixel, 4);
-  size_t pixel_idx = pixel_channels[0] * 3 + pixel_channels[1] * 5 +
-                     pixel_channels[2] * 7 + pixel_channels[3] * 11;
-  pixel_idx %= 64;
+  // Anything computed from the pixel alone can be reused when it
+  // repeats the previous pixel, as it does throughout a run.
+  const bool repeat = decoder->px_out_valid && pixel == decoder->px_prev;
+
+  decoder->keyed = (stream->flags & QOI_FLAG_COLOR_KEY) &&
+                   ((pixel ^ stream->color_key) & 0xFFFFFF) == 0;
+
+  uint32_t out_pixel = pixel;
+  if (repeat) {
+    out_pixel = decoder->px_out;
+  } else {
+    if (stream->lut_size > 0) out_pixel = qoi_lut_pixel(stream, out_pixel);
+    if (stream->flags & (QOI_FLAG_PREMULTIPLY | QOI_FLAG_BLEND_COLOR))
+      out_pixel = qoi_compose_pixel(stream, out_pixel);
+    decoder->px_out = out_pixel;
+    decoder->px_out_valid = 1;
+  }
+  decoder->alpha = (stream->desc.channels == 3) ? 0xFF : out_pixel >> 24;
+
+  if (qoi_format_is_single(stream->format)) {
+    qoi_format_single(decoder, stream, out_pixel, repeat);
+  } else if (stream->format == QOI_FORMAT_INDEX8) {
+    decoder->tmp_buf.v =
+        qoi_format_index(decoder, stream, pixel_idx, pixel, out_pixel);
+    decoder->tmp_buf_size = 1;
+  } else if (stream->format == QOI_FORMAT_LINEAR16 ||
+             stream->format == QOI_FORMAT_LINEAR32F) {
+    decoder->tmp_buf_size = qoi_format_linear(stream->format, &stream->desc,
+                                              out_pixel, decoder->tmp_buf.b);
+  } else {
+    decoder->tmp_buf_size = qoi_format_pixel(
+        stream->format, stream->desc.channels, out_pixel, &decoder->tmp_buf.v);
+  }
+  if (stream->flags & QOI_FLAG_NORMALIZE) qoi_normalize(decoder, stream);
+  decoder->pixel_size = decoder->tmp_buf_size;
+  decoder->px_prev = pixel;
+  if (decoder->profile == QOI_PROFILE_EXTENDED)
+    decoder->index_big[hash % 256] = pixel;
   decoder->index[pixel_idx] = pixel;
+}
+
+static int qoi_output_pixel(qoi_decoder_state *decoder, qoi_stream *stream,
+                            uint32_t pixel) {
+  qoi_stage_pixel(decoder, stream, pixel);
+
+  // Mark rows that have any pixel with an alpha above the threshold.
+  uint32_t summary_byte = decoder->row / 8;
+  if (summary_byte < stream->row_summary_size) {
+    uint8_t alpha = (stream->desc.channels == 3) ? 0xFF : pixel >> 24;
+    if (alpha > stream->threshold)
+      stream->row_summary[summary_byte] |= 0x80 >> (decoder->row & 7);
+  }
+
+  if (stream->flags & QOI_FLAG_CHECKSUM)
+    decoder->checksum =
+        qoi_crc32c_pixel(decoder->checksum, pixel, stream->desc.channels);
+
+  // Report the start of each span of pixels that are not keyed out.
+  if (decoder->keyed) {
+    decoder->in_span = 0;
+  } else if ((stream->flags & QOI_FLAG_KEY_SPANS) && !decoder->in_span) {
+    decoder->in_span = 1;
+    stream->span.offset =
+        size_t(decoder->row) * stream->desc.width + decoder->column;
+    stream->span.length = stream->desc.width - decoder->column;
+    decoder->progress = QOI_PROGRESS_BUFFERED_OUTPUT;
+    return QOI_STATUS_OPAQUE_SPAN;
+  }
 
   return qoi_progress_buffered_output(decoder, stream);
 }
 
+// Accounts for `count` repeats of the previous pixel that are not
+// output one at a time, as if they had been.
+static void qoi_advance_pixels(qoi_decoder_state *decoder,
+                               qoi_stream *stream, size_t count) {
+  if (count == 0) return;
+
+  if (stream->flags & QOI_FLAG_CHECKSUM) {
+    for (size_t i = 0; i < count; ++i)
+      decoder->checksum = qoi_crc32c_pixel(decoder->checksum, decoder->px_prev,
+                                           stream->desc.channels);
+  }
+
+  // Mark every row touched by the pixels.
+  uint8_t alpha =
+      (stream->desc.channels == 3) ? 0xFF : decoder->px_prev >> 24;
+  if (alpha > stream->threshold) {
+    uint32_t last_row =
+        decoder->row + (decoder->column + count - 1) / stream->desc.width;
+    for (uint32_t row = decoder->row; row <= last_row; ++row) {
+      if (row / 8 >= stream->row_summary_size) break;
+      stream->row_summary[row / 8] |= 0x80 >> (row & 7);
+    }
+  }
+
+  decoder->pixel_length_remaining -= count;
+  decoder->total_pixels += count;
+  if (decoder->container == QOI_CONTAINER_ANIM)
+    decoder->span_remaining -= count;
+  decoder->row += (decoder->column + count) / stream->desc.width;
+  decoder->column = (decoder->column + count) % stream->desc.width;
+  decoder->in_span = 0;
+}
+
+// Skips over as much of a pending run of keyed-out pixels as possible
+// at once, leaving its last pixel, and the last pixel of the image or
+// animation span, to be output normally.
+static void qoi_skip_keyed_run(qoi_decoder_state *decoder,
+                               qoi_stream *stream) {
+  size_t count = decoder->pending_run_count - 1;
+  if (count >= decoder->pixel_length_remaining)
+    count = decoder->pixel_length_remaining - 1;
+  if (decoder->container == QOI_CONTAINER_ANIM &&
+      count >= decoder->span_remaining)
+    count = decoder->span_remaining - 1;
+
+  // Keyed pixels still take up space unless spans are reported.
+  if (!(stream->flags & QOI_FLAG_KEY_SPANS)) {
+    size_t size = (stream->flags & QOI_FLAG_PLANAR)
+                      ? ((stream->flags & QOI_FLAG_NORMALIZE) ? sizeof(float)
+                                                              : 1)
+                      : decoder->pixel_size;
+    if (count > stream->out_buf_size / size)
+      count = stream->out_buf_size / size;
+    stream->out_buf += count * size;
+    stream->out_buf_size -= count * size;
+  }
+
+  decoder->pending_run_count -= count;
+  qoi_advance_pixels(decoder, stream, count);
+}
+
 #define TMP_BUF_RESET()   \
   decoder->tmp_buf.v = 0; \
   decoder->tmp_buf_size = 0;
@@ -102,6 +652,116 @@ static int qoi_output_pixel(qoi_decoder_state *decoder, qoi_stream *stream,
     return QOI_STATUS_ERR_INTERNAL;                           \
   }
 
+// Reports the pending `QOI_OP_RUN`, together with any runs directly
+// following it in the input, as a single `QOI_STATUS_RUN` for
+// `QOI_FLAG_RUNS`.
+static int qoi_output_run(qoi_decoder_state *decoder, qoi_stream *stream) {
+  const size_t limit = (decoder->container == QOI_CONTAINER_ANIM)
+                           ? decoder->span_remaining
+                           : decoder->pixel_length_remaining;
+  // The extended profile's long runs are not merged, as their counts
+  // may be split across input buffers.
+  const uint8_t run_end = (decoder->profile == QOI_PROFILE_EXTENDED)
+                              ? QOI_OP_RUN_LONG
+                              : 0b11111110;
+  size_t length = decoder->pending_run_count;
+  decoder->pending_run_count = 0;
+  while (length < limit && stream->in_buf_size > 0 &&
+         stream->in_buf[0] >= 0b11000000 && stream->in_buf[0] < run_end) {
+    length += (stream->in_buf[0] & 0b111111) + 1;
+    stream->in_buf += 1;
+    stream->in_buf_size -= 1;
+  }
+
+  // As when runs are output pixel by pixel, runs past the end of an
+  // image are cut short, while those past the end of an animation span
+  // are invalid.
+  if (length > limit) {
+    if (decoder->container == QOI_CONTAINER_ANIM) {
+      decoder->progress = QOI_PROGRESS_INVALID;
+      return QOI_STATUS_ERR_FORMAT;
+    }
+    length = limit;
+  }
+
+  qoi_stage_pixel(decoder, stream, decoder->px_prev);
+  stream->run_color = decoder->tmp_buf.v;
+  TMP_BUF_RESET();
+
+  stream->span.offset =
+      size_t(decoder->row) * stream->desc.width + decoder->column;
+  stream->span.length = length;
+  qoi_advance_pixels(decoder, stream, length);
+
+  // Keyed-out runs are dropped without being reported, but still take
+  // up space like other keyed pixels, so that the pixels after them
+  // land in place.
+  if (decoder->keyed) {
+    size_t size = length * decoder->pixel_size;
+    if (size > stream->out_buf_size) size = stream->out_buf_size;
+    stream->out_buf += size;
+    stream->out_buf_size -= size;
+    return qoi_progress_pixel_done(decoder, stream);
+  }
+  decoder->progress = QOI_PROGRESS_PIXEL_DONE;
+  return QOI_STATUS_RUN;
+}
+
+// Resets the previous pixel and `index` to their values at the start
+// of an image, which are given by `dictionary` if there is one.
+static void qoi_reset_prediction(qoi_decoder_state *decoder,
+                                 const qoi_dictionary *dictionary) {
+  if (dictionary) {
+    qoi_dictionary_load(dictionary, &decoder->px_prev, decoder->index);
+  } else {
+    decoder->px_prev = 0xFF000000;
+    memset(decoder->index, 0, sizeof(decoder->index));
+  }
+  // Nothing has been computed for the starting pixel or index yet.
+  decoder->px_out_valid = 0;
+  decoder->palette_valid = 0;
+}
+
+// Resets the per-image parts of the decoder state so that decoding
+// can continue with the next image of a multi-frame stream.
+static void qoi_reset_image(qoi_decoder_state *decoder) {
+  decoder->progress = QOI_PROGRESS_AWAIT_MAGIC;
+  decoder->pixel_length_remaining = 0;
+  qoi_reset_prediction(decoder, nullptr);
+  decoder->pending_run_count = 0;
+  TMP_BUF_RESET();
+}
+
+// Reads a varint of up to 32 bits, stored as little-endian groups of 7
+// bits with the high bit of each byte marking a continuation. Partial
+// values are accumulated in the internal buffer. Returns
+// `QOI_STATUS_DONE` once `*value` has been read.
+static int qoi_read_varint(qoi_decoder_state *decoder, qoi_stream *stream,
+                           uint32_t *value) {
+  while (stream->in_buf_size > 0) {
+    uint8_t byte = stream->in_buf[0];
+    // The fifth byte only has room for the top 4 bits of the value.
+    if (decoder->tmp_buf_size == 4 && byte > 0x0F) {
+      decoder->progress = QOI_PROGRESS_INVALID;
+      return QOI_STATUS_ERR_FORMAT;
+    }
+
+    decoder->tmp_buf.v |= uint32_t(byte & 0x7F)
+                          << (7 * decoder->tmp_buf_size);
+    decoder->tmp_buf_size += 1;
+    stream->in_buf += 1;
+    stream->in_buf_size -= 1;
+
+    if (!(byte & 0x80)) {
+      *value = decoder->tmp_buf.v;
+      TMP_BUF_RESET();
+      return QOI_STATUS_DONE;
+    }
+  }
+
+  return QOI_STATUS_INPUT_EXHAUSTED;
+}
+
 static int qoi_progress_invalid(qoi_decoder_state *, qoi_stream *) {
   // Once the decoder is in an invalid state, it never exists it
   // until it is re-initialized.
@@ -118,8 +778,19 @@ static int qoi_progress_await_magic(qoi_decoder_state *decoder,
   qoi_shift_bytes(decoder, stream, MAGIC_SIZE);
   if (decoder->tmp_buf_size < MAGIC_SIZE) return QOI_STATUS_INPUT_EXHAUSTED;
 
-  // Verify the magic constant.
-  if (memcmp(&decoder->tmp_buf, qoi_magic, MAGIC_SIZE)) {
+  // Verify the magic constant, which also selects the container and
+  // the opcode profile.
+  decoder->profile = QOI_PROFILE_STANDARD;
+  if (!memcmp(&decoder->tmp_buf, qoi_magic, MAGIC_SIZE)) {
+    decoder->container = QOI_CONTAINER_IMAGE;
+  } else if (!memcmp(&decoder->tmp_buf, qoi_extended_magic, MAGIC_SIZE)) {
+    decoder->container = QOI_CONTAINER_IMAGE;
+    decoder->profile = QOI_PROFILE_EXTENDED;
+  } else if (!memcmp(&decoder->tmp_buf, qoi_anim_magic, MAGIC_SIZE)) {
+    decoder->container = QOI_CONTAINER_ANIM;
+  } else if (!memcmp(&decoder->tmp_buf, qoi_interlace_magic, MAGIC_SIZE)) {
+    decoder->container = QOI_CONTAINER_INTERLACED;
+  } else {
     decoder->progress = QOI_PROGRESS_INVALID;
     return QOI_STATUS_ERR_FORMAT;
   }
@@ -159,7 +830,8 @@ static int qoi_progress_await_height(qoi_decoder_state *decoder,
 
   // Read the height.
   stream->desc.height = __builtin_bswap32(decoder->tmp_buf.v);
-  if (stream->desc.height >= QOI_PIXELS_MAX / stream->desc.width) {
+  if (stream->desc.width == 0 || stream->desc.height == 0 ||
+      stream->desc.height >= QOI_PIXELS_MAX / stream->desc.width) {
     decoder->progress = QOI_PROGRESS_INVALID;
     return QOI_STATUS_ERR_FORMAT;
   }
@@ -213,6 +885,62 @@ static int qoi_progress_await_colorspace(qoi_decoder_state *decoder,
     return QOI_STATUS_ERR_FORMAT;
   }
   stream->desc.colorspace = colorspace;
+  stream->frame = decoder->frame;
+  decoder->checksum = 0xFFFFFFFF;
+  decoder->column = 0;
+  decoder->row = 0;
+  decoder->in_span = 0;
+  decoder->pass = 0;
+  // Interlaced pixels are written in place, one whole pixel at a time.
+  if (decoder->container == QOI_CONTAINER_INTERLACED &&
+      (stream->format == QOI_FORMAT_MONO1 ||
+       stream->format == QOI_FORMAT_ALPHA1 ||
+       (stream->flags & (QOI_FLAG_PLANAR | QOI_FLAG_IN_PLACE |
+                         QOI_FLAG_BLEND_DEST | QOI_FLAG_KEY_SPANS |
+                         QOI_FLAG_RUNS)))) {
+    decoder->progress = QOI_PROGRESS_INVALID;
+    return QOI_STATUS_ERR_PARAM;
+  }
+  // Animation frames load the dictionary themselves.
+  if (stream->dictionary && decoder->container != QOI_CONTAINER_ANIM)
+    qoi_reset_prediction(decoder, stream->dictionary);
+
+  stream->in_buf += 1;
+  stream->in_buf_size -= 1;
+
+  if (decoder->container == QOI_CONTAINER_ANIM)
+    return qoi_progress_anim_frame(decoder, stream);
+  if (decoder->profile == QOI_PROFILE_EXTENDED)
+    return qoi_progress_await_version(decoder, stream);
+  return qoi_progress_new_pixel(decoder, stream);
+}
+
+static int qoi_progress_await_version(qoi_decoder_state *decoder,
+                                      qoi_stream *stream) {
+  decoder->progress = QOI_PROGRESS_AWAIT_VERSION;
+
+  // Check that the input is ready.
+  if (stream->in_buf_size < 1) return QOI_STATUS_INPUT_EXHAUSTED;
+
+  // Only the version of the extended profile described in the header
+  // is known.
+  if (stream->in_buf[0] != QOI_PROFILE_VERSION) {
+    decoder->progress = QOI_PROGRESS_INVALID;
+    return QOI_STATUS_ERR_FORMAT;
+  }
+
+  // Validation never looks up the big index, so only decoding needs it.
+  if (!(stream->flags & QOI_FLAG_VALIDATE)) {
+    // The big index lives in the extended state, which the caller can
+    // still supply before calling again.
+    if (!decoder->index_big) return QOI_STATUS_ERR_PARAM;
+
+    // The big index starts out holding only the previous pixel, which a
+    // leading run would store in it.
+    memset(decoder->index_big, 0, sizeof(qoi_extended_state::index_big));
+    decoder->index_big[qoi_pixel_hash(decoder->px_prev) % 256] =
+        decoder->px_prev;
+  }
 
   stream->in_buf += 1;
   stream->in_buf_size -= 1;
@@ -222,12 +950,19 @@ static int qoi_progress_await_colorspace(qoi_decoder_state *decoder,
 
 static int qoi_progress_new_pixel(qoi_decoder_state *decoder,
                                   qoi_stream *stream) {
+  if (stream->flags & QOI_FLAG_VALIDATE)
+    return qoi_progress_validate(decoder, stream);
+
   decoder->progress = QOI_PROGRESS_NEW_PIXEL;
 
   // Before decoding a new command from the input, first check for
   // any pending `QOI_OP_RUN` commands. These must be drained before
   // we read any more input.
   if (decoder->pending_run_count > 0) {
+    if (decoder->keyed && decoder->px_out_valid &&
+        decoder->pending_run_count > 1 &&
+        decoder->container != QOI_CONTAINER_INTERLACED)
+      qoi_skip_keyed_run(decoder, stream);
     decoder->pending_run_count -= 1;
     return qoi_output_pixel(decoder, stream, decoder->px_prev);
   }
@@ -239,7 +974,24 @@ static int qoi_progress_new_pixel(qoi_decoder_state *decoder,
   uint8_t byte0 = decoder->tmp_buf.b[0];
 
   // Dispatch based on the first byte.
-  if (byte0 == 0b11111110) {
+  if (decoder->profile == QOI_PROFILE_EXTENDED && byte0 == QOI_OP_RUN_LONG) {
+    qoi_shift_bytes(decoder, stream, 3);
+    if (decoder->tmp_buf_size < 3) return QOI_STATUS_INPUT_EXHAUSTED;
+
+    decoder->pending_run_count = QOI_RUN_LONG_MIN +
+                                 (decoder->tmp_buf.b[1] << 8 |
+                                  decoder->tmp_buf.b[2]);
+    TMP_BUF_RESET();
+    if (stream->flags & QOI_FLAG_RUNS) return qoi_output_run(decoder, stream);
+    return qoi_progress_new_pixel(decoder, stream);
+  } else if (decoder->profile == QOI_PROFILE_EXTENDED &&
+             byte0 == QOI_OP_INDEX_BIG) {
+    qoi_shift_bytes(decoder, stream, 2);
+    if (decoder->tmp_buf_size < 2) return QOI_STATUS_INPUT_EXHAUSTED;
+
+    uint32_t pixel = decoder->index_big[decoder->tmp_buf.b[1]];
+    return qoi_output_pixel(decoder, stream, pixel);
+  } else if (byte0 == 0b11111110) {
     // QOI_OP_RGB
     qoi_shift_bytes(decoder, stream, 4);
     if (decoder->tmp_buf_size < 4) return QOI_STATUS_INPUT_EXHAUSTED;
@@ -296,6 +1048,8 @@ static int qoi_progress_new_pixel(qoi_decoder_state *decoder,
     case 0b11000000: {
       // QOI_OP_RUN
       decoder->pending_run_count = (byte0 & 0b111111) + 1;
+      if (stream->flags & QOI_FLAG_RUNS)
+        return qoi_output_run(decoder, stream);
       return qoi_progress_new_pixel(decoder, stream);
     }
   }
@@ -321,28 +1075,168 @@ static int qoi_progress_op_rgba(qoi_decoder_state *decoder,
   return qoi_output_pixel(decoder, stream, pixel);
 }
 
+// Moves on to the next pixel of an interlaced image, skipping any
+// passes that have no pixels in an image this small. Returns whether
+// the current pass has ended.
+static bool qoi_interlace_advance(qoi_decoder_state *decoder,
+                                  const qoi_desc *desc) {
+  const qoi_interlace_pass *pass = &qoi_interlace_passes[decoder->pass];
+  decoder->column += pass->dx;
+  if (decoder->column < desc->width) return false;
+  decoder->row += pass->dy;
+  if (decoder->row < desc->height) {
+    decoder->column = pass->x;
+    return false;
+  }
+
+  while (++decoder->pass < QOI_INTERLACE_PASSES) {
+    pass = &qoi_interlace_passes[decoder->pass];
+    if (pass->x < desc->width && pass->y < desc->height) break;
+  }
+  if (decoder->pass < QOI_INTERLACE_PASSES) {
+    decoder->column = pass->x;
+    decoder->row = pass->y;
+  }
+  return true;
+}
+
+// Writes the buffered pixel of an interlaced image in place, filling
+// its whole block with `QOI_FLAG_PREVIEW`.
+static int qoi_interlace_output(qoi_decoder_state *decoder,
+                                qoi_stream *stream) {
+  const qoi_desc *desc = &stream->desc;
+  const qoi_interlace_pass *pass = &qoi_interlace_passes[decoder->pass];
+  uint32_t w = 1, h = 1;
+  if (stream->flags & QOI_FLAG_PREVIEW) {
+    const uint32_t columns_left = desc->width - decoder->column;
+    const uint32_t rows_left = desc->height - decoder->row;
+    w = (pass->w < columns_left) ? pass->w : columns_left;
+    h = (pass->h < rows_left) ? pass->h : rows_left;
+  }
+
+  // The block's last pixel must lie within the output buffer, which
+  // holds the whole image and so cannot be continued in another.
+  const size_t size = decoder->tmp_buf_size;
+  const size_t end =
+      (size_t(decoder->row + h - 1) * desc->width + decoder->column + w) *
+      size;
+  if (size > 0 && end > stream->out_buf_size) return QOI_STATUS_ERR_PARAM;
+
+  if (!decoder->keyed && size > 0) {
+    unsigned char *out =
+        stream->out_buf +
+        (size_t(decoder->row) * desc->width + decoder->column) * size;
+    for (uint32_t y = 0; y < h; ++y, out += desc->width * size)
+      for (uint32_t x = 0; x < w; ++x)
+        memcpy(out + x * size, &decoder->tmp_buf, size);
+  }
+
+  decoder->pixel_length_remaining -= 1;
+  decoder->total_pixels += 1;
+  TMP_BUF_RESET();
+
+  if (qoi_interlace_advance(decoder, desc) &&
+      (stream->flags & QOI_FLAG_PREVIEW) &&
+      decoder->pixel_length_remaining > 0) {
+    decoder->progress = QOI_PROGRESS_PIXEL_DONE;
+    return QOI_STATUS_PASS_DONE;
+  }
+  return qoi_progress_pixel_done(decoder, stream);
+}
+
 static int qoi_progress_buffered_output(qoi_decoder_state *decoder,
                                         qoi_stream *stream) {
   decoder->progress = QOI_PROGRESS_BUFFERED_OUTPUT;
 
-  if (stream->out_buf_size == 0) return QOI_STATUS_OUTPUT_EXHAUSTED;
+  // Keyed-out pixels take up no space when spans are reported.
+  if (decoder->keyed && (stream->flags & QOI_FLAG_KEY_SPANS))
+    decoder->tmp_buf_size = 0;
 
-  // Output as many bytes as we have space for in the output buffer.
-  size_t count = (decoder->tmp_buf_size > stream->out_buf_size)
-                     ? stream->out_buf_size
-                     : decoder->tmp_buf_size;
-  memcpy(stream->out_buf, &decoder->tmp_buf, count);
-  decoder->tmp_buf.v >>= 8 * count;
-  decoder->tmp_buf_size -= count;
-  stream->out_buf += count;
-  stream->out_buf_size -= count;
+  if (decoder->container == QOI_CONTAINER_INTERLACED)
+    return qoi_interlace_output(decoder, stream);
+
+  // Some formats produce no output for some pixels.
+  if (decoder->tmp_buf_size > 0 && stream->out_buf_size == 0)
+    return QOI_STATUS_OUTPUT_EXHAUSTED;
+
+  if (stream->flags & QOI_FLAG_PLANAR) {
+    // Write one channel to each plane, always whole.
+    const size_t element =
+        (stream->flags & QOI_FLAG_NORMALIZE) ? sizeof(float) : 1;
+    if (decoder->tmp_buf_size > 0) {
+      if (stream->out_buf_size < element) return QOI_STATUS_OUTPUT_EXHAUSTED;
+      for (size_t i = 0;
+           !decoder->keyed && i * element < decoder->tmp_buf_size; ++i)
+        memcpy(stream->out_buf + i * stream->plane_pitch,
+               decoder->tmp_buf.b + i * element, element);
+      stream->out_buf += element;
+      stream->out_buf_size -= element;
+      decoder->tmp_buf_size = 0;
+    }
+  } else {
+    // Output as many bytes as we have space for in the output buffer.
+    size_t count = (decoder->tmp_buf_size > stream->out_buf_size)
+                       ? stream->out_buf_size
+                       : decoder->tmp_buf_size;
+
+    // Blending needs the whole of the destination pixel at once.
+    const bool blend =
+        (stream->flags & QOI_FLAG_BLEND_DEST) && decoder->tmp_buf_size > 0;
+    if (blend && count < decoder->tmp_buf_size)
+      return QOI_STATUS_OUTPUT_EXHAUSTED;
+
+    // When decoding in place, never overwrite input that is still to be
+    // read.
+    if ((stream->flags & QOI_FLAG_IN_PLACE) && stream->in_buf_size > 0 &&
+        stream->out_buf + count > stream->in_buf) {
+      decoder->progress = QOI_PROGRESS_INVALID;
+      return QOI_STATUS_ERR_OVERLAP;
+    }
 
-  if (decoder->tmp_buf_size > 0) return QOI_STATUS_OUTPUT_EXHAUSTED;
+    if (decoder->keyed) {
+      // Leave the destination untouched.
+    } else if (blend) {
+      qoi_blend_dest(decoder, stream);
+    } else {
+      memcpy(stream->out_buf, &decoder->tmp_buf, count);
+    }
+    decoder->tmp_buf_size -= count;
+    stream->out_buf += count;
+    stream->out_buf_size -= count;
+
+    if (decoder->tmp_buf_size > 0) {
+      memmove(decoder->tmp_buf.b, decoder->tmp_buf.b + count,
+              decoder->tmp_buf_size);
+      return QOI_STATUS_OUTPUT_EXHAUSTED;
+    }
+  }
 
   // Only mark the pixel as complete after we've drained the temp buffer.
   decoder->pixel_length_remaining -= 1;
+  decoder->total_pixels += 1;
   TMP_BUF_RESET();
 
+  decoder->column += 1;
+  if (decoder->column == stream->desc.width) {
+    decoder->column = 0;
+    decoder->in_span = 0;
+    decoder->row += 1;
+  }
+
+  if (decoder->container == QOI_CONTAINER_ANIM) decoder->span_remaining -= 1;
+  return qoi_progress_pixel_done(decoder, stream);
+}
+
+// Continues with the next pixel, or ends the image or animation span,
+// once the current pixel or run has been output.
+static int qoi_progress_pixel_done(qoi_decoder_state *decoder,
+                                   qoi_stream *stream) {
+  if (decoder->container == QOI_CONTAINER_ANIM) {
+    if (decoder->span_remaining == 0)
+      return qoi_anim_span_done(decoder, stream);
+    return qoi_progress_new_pixel(decoder, stream);
+  }
+
   if (decoder->pixel_length_remaining > 0) {
     return qoi_progress_new_pixel(decoder, stream);
   } else {
@@ -350,6 +1244,114 @@ static int qoi_progress_buffered_output(qoi_decoder_state *decoder,
   }
 }
 
+// In `QOI_FLAG_VALIDATE` mode, opcodes are only parsed for their
+// length and pixel count, so none of the pixel reconstruction work
+// is done. The internal buffer size holds the number of operand bytes
+// of the current opcode that are still to be skipped.
+static int qoi_progress_validate(qoi_decoder_state *decoder,
+                                 qoi_stream *stream) {
+  decoder->progress = QOI_PROGRESS_VALIDATE;
+
+  const bool anim = decoder->container == QOI_CONTAINER_ANIM;
+  size_t remaining =
+      anim ? decoder->span_remaining : decoder->pixel_length_remaining;
+  const size_t start_remaining = remaining;
+
+  const unsigned char *in = stream->in_buf;
+  const unsigned char *in_end = in + stream->in_buf_size;
+  const bool extended = decoder->profile == QOI_PROFILE_EXTENDED;
+
+  // Operands split across input buffers are skipped, except for the
+  // count of a `QOI_OP_RUN_LONG`, which is gathered after its opcode
+  // in the internal buffer.
+  if (extended && decoder->tmp_buf.b[0] == QOI_OP_RUN_LONG) {
+    while (decoder->tmp_buf_size > 0 && in < in_end) {
+      decoder->tmp_buf.b[3 - decoder->tmp_buf_size] = *in++;
+      decoder->tmp_buf_size -= 1;
+    }
+    if (decoder->tmp_buf_size == 0) {
+      size_t pixels = QOI_RUN_LONG_MIN +
+                      (decoder->tmp_buf.b[1] << 8 | decoder->tmp_buf.b[2]);
+      remaining -= (pixels > remaining) ? remaining : pixels;
+      TMP_BUF_RESET();
+    }
+  } else {
+    size_t skip = decoder->tmp_buf_size;
+    if (skip > size_t(in_end - in)) skip = in_end - in;
+    in += skip;
+    decoder->tmp_buf_size -= skip;
+  }
+
+  while (decoder->tmp_buf_size == 0 && remaining > 0 && in < in_end) {
+    uint8_t byte0 = *in++;
+
+    size_t pixels = 1;
+    uint8_t operands = 0;
+    if (extended && byte0 == QOI_OP_RUN_LONG) {
+      // QOI_OP_RUN_LONG
+      if (in_end - in < 2) {
+        decoder->tmp_buf.b[0] = byte0;
+        decoder->tmp_buf_size = 2;
+        while (in < in_end) {
+          decoder->tmp_buf.b[3 - decoder->tmp_buf_size] = *in++;
+          decoder->tmp_buf_size -= 1;
+        }
+        break;
+      }
+      pixels = QOI_RUN_LONG_MIN + (in[0] << 8 | in[1]);
+      operands = 2;
+    } else if (extended && byte0 == QOI_OP_INDEX_BIG) {
+      // QOI_OP_INDEX_BIG
+      operands = 1;
+    } else if (byte0 == 0b11111110) {
+      // QOI_OP_RGB
+      operands = 3;
+    } else if (byte0 == 0b11111111) {
+      // QOI_OP_RGBA
+      operands = 4;
+    } else if ((byte0 & 0b11000000) == 0b10000000) {
+      // QOI_OP_LUMA
+      operands = 1;
+    } else if ((byte0 & 0b11000000) == 0b11000000) {
+      // QOI_OP_RUN
+      pixels = (byte0 & 0b111111) + 1;
+    }
+
+    if (pixels > remaining) {
+      // As when decoding, a run may not extend past the end of an
+      // animation span, and is cut short at the end of an image.
+      if (anim) {
+        stream->in_buf_size -= (in - 1) - stream->in_buf;
+        stream->in_buf = in - 1;
+        decoder->progress = QOI_PROGRESS_INVALID;
+        return QOI_STATUS_ERR_FORMAT;
+      }
+      pixels = remaining;
+    }
+    remaining -= pixels;
+
+    size_t available = in_end - in;
+    if (operands > available) {
+      decoder->tmp_buf_size = operands - available;
+      operands = available;
+    }
+    in += operands;
+  }
+
+  size_t pixels = start_remaining - remaining;
+  decoder->pixel_length_remaining -= pixels;
+  decoder->total_pixels += pixels;
+  if (anim) decoder->span_remaining = remaining;
+  stream->in_buf_size -= in - stream->in_buf;
+  stream->in_buf = in;
+
+  if (decoder->tmp_buf_size > 0 || remaining > 0)
+    return QOI_STATUS_INPUT_EXHAUSTED;
+
+  if (anim) return qoi_anim_span_done(decoder, stream);
+  return qoi_progress_await_tail(decoder, stream);
+}
+
 static int qoi_progress_await_tail(qoi_decoder_state *decoder,
                                    qoi_stream *stream) {
   decoder->progress = QOI_PROGRESS_AWAIT_TAIL;
@@ -365,44 +1367,150 @@ static int qoi_progress_await_tail(qoi_decoder_state *decoder,
       return qoi_progress_await_tail(decoder, stream);
     }
   } else if (decoder->tmp_buf.v == 7) {
-    if (stream->in_buf[0] == 1) return QOI_STATUS_DONE;
+    if (stream->in_buf[0] == 1) {
+      // Consume the final byte of the tail, so that `in_buf` is left
+      // just past the end of the image.
+      stream->in_buf += 1;
+      stream->in_buf_size -= 1;
+      stream->checksum = ~decoder->checksum;
+
+      if (decoder->container == QOI_CONTAINER_ANIM ||
+          !(stream->flags & QOI_FLAG_MULTI_FRAME))
+        return qoi_progress_done(decoder, stream);
+
+      // In multi-frame mode, the next call starts on the header of the
+      // next image.
+      decoder->frame += 1;
+      qoi_reset_image(decoder);
+      return QOI_STATUS_FRAME_DONE;
+    }
   }
 
   decoder->progress = QOI_PROGRESS_INVALID;
   return QOI_STATUS_ERR_FORMAT;
 }
 
-int qoi_decode(qoi_stream *stream) {
-#if __CHERIOT__
-  if (!CHERI::check_pointer<CHERI::PermissionSet{
-          CHERI::Permission::Load, CHERI::Permission::Store,
-          CHERI::Permission::LoadMutable,
-          CHERI::Permission::LoadStoreCapability}>(stream, sizeof(qoi_stream)))
-    return QOI_STATUS_ERR_PARAM;
+static int qoi_progress_done(qoi_decoder_state *decoder, qoi_stream *) {
+  // Once the whole input has been decoded, further calls have no
+  // effect until the decoder is re-initialized.
+  decoder->progress = QOI_PROGRESS_DONE;
+  return QOI_STATUS_DONE;
+}
 
-  if (stream->in_buf_size > 0 &&
-      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Store}>(
-          stream->in_buf, stream->in_buf_size))
-    return QOI_STATUS_ERR_PARAM;
+// Starts a span of `length` coded pixels within an animation frame,
+// reporting its position to the caller before any of it is decoded.
+static int qoi_anim_begin_span(qoi_decoder_state *decoder, qoi_stream *stream,
+                               size_t length) {
+  if (length == 0) return qoi_anim_span_done(decoder, stream);
 
-  if (stream->out_buf_size > 0 &&
-      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Store}>(
-          stream->out_buf, stream->out_buf_size))
-    return QOI_STATUS_ERR_PARAM;
-#endif
+  decoder->span_remaining = length;
+  size_t frame_length = stream->desc.width * stream->desc.height;
+  stream->span.offset = frame_length - decoder->pixel_length_remaining;
+  stream->span.length = length;
+  decoder->column = stream->span.offset % stream->desc.width;
+  decoder->row = stream->span.offset / stream->desc.width;
+  decoder->in_span = 0;
 
-  qoi_decoder_state *decoder = qoi_unseal(stream->decoder_state);
-  if (!decoder) return QOI_STATUS_ERR_PARAM;
+  // Spans are not reported when validating.
+  if (stream->flags & QOI_FLAG_VALIDATE)
+    return qoi_progress_validate(decoder, stream);
 
-#if __CHERIOT__
-  if (!CHERI::check_pointer<CHERI::PermissionSet{
-                                CHERI::Permission::Load,
-                                CHERI::Permission::Store},
-                            true, true>(decoder, sizeof(qoi_decoder_state)))
-    return QOI_STATUS_ERR_PARAM;
-#endif
+  decoder->progress = QOI_PROGRESS_NEW_PIXEL;
+  return QOI_STATUS_SPAN;
+}
+
+// Called once all pixels of the current animation span are decoded.
+static int qoi_anim_span_done(qoi_decoder_state *decoder, qoi_stream *stream) {
+  // A `QOI_OP_RUN` may not extend past the end of its span.
+  if (decoder->pending_run_count > 0) {
+    decoder->progress = QOI_PROGRESS_INVALID;
+    return QOI_STATUS_ERR_FORMAT;
+  }
+
+  if (decoder->pixel_length_remaining > 0)
+    return qoi_progress_anim_skip(decoder, stream);
+
+  decoder->frame += 1;
+  stream->checksum = ~decoder->checksum;
+  decoder->progress = QOI_PROGRESS_ANIM_FRAME;
+  return QOI_STATUS_FRAME_DONE;
+}
+
+static int qoi_progress_anim_frame(qoi_decoder_state *decoder,
+                                   qoi_stream *stream) {
+  decoder->progress = QOI_PROGRESS_ANIM_FRAME;
+
+  // We don't use the internal buffer here, so verify that
+  // it's empty.
+  VERIFY_TMP_BUF_RESET();
+
+  // Check that the input is ready.
+  if (stream->in_buf_size < 1) return QOI_STATUS_INPUT_EXHAUSTED;
+
+  // A zero byte starts the tail that ends the animation.
+  uint8_t frame_flags = stream->in_buf[0];
+  if (frame_flags == 0) return qoi_progress_await_tail(decoder, stream);
+
+  if ((frame_flags & ~(QOI_ANIM_FRAME_DELTA | QOI_ANIM_FRAME_CARRY)) !=
+      QOI_ANIM_FRAME) {
+    decoder->progress = QOI_PROGRESS_INVALID;
+    return QOI_STATUS_ERR_FORMAT;
+  }
+  decoder->frame_flags = frame_flags;
+
+  stream->in_buf += 1;
+  stream->in_buf_size -= 1;
+
+  if (!(frame_flags & QOI_ANIM_FRAME_CARRY))
+    qoi_reset_prediction(decoder, stream->dictionary);
+
+  size_t frame_length = stream->desc.width * stream->desc.height;
+  decoder->pixel_length_remaining = frame_length;
+  stream->frame = decoder->frame;
+  decoder->checksum = 0xFFFFFFFF;
+
+  if ((frame_flags & QOI_ANIM_FRAME_DELTA) && frame_length > 0)
+    return qoi_progress_anim_skip(decoder, stream);
+  return qoi_anim_begin_span(decoder, stream, frame_length);
+}
+
+static int qoi_progress_anim_skip(qoi_decoder_state *decoder,
+                                  qoi_stream *stream) {
+  decoder->progress = QOI_PROGRESS_ANIM_SKIP;
+
+  // Read the number of pixels unchanged since the previous frame.
+  uint32_t skip;
+  int r = qoi_read_varint(decoder, stream, &skip);
+  if (r != QOI_STATUS_DONE) return r;
+
+  if (skip > decoder->pixel_length_remaining) {
+    decoder->progress = QOI_PROGRESS_INVALID;
+    return QOI_STATUS_ERR_FORMAT;
+  }
+  decoder->pixel_length_remaining -= skip;
+
+  return qoi_progress_anim_count(decoder, stream);
+}
+
+static int qoi_progress_anim_count(qoi_decoder_state *decoder,
+                                   qoi_stream *stream) {
+  decoder->progress = QOI_PROGRESS_ANIM_COUNT;
+
+  // Read the number of changed pixels that follow.
+  uint32_t count;
+  int r = qoi_read_varint(decoder, stream, &count);
+  if (r != QOI_STATUS_DONE) return r;
+
+  if (count > decoder->pixel_length_remaining) {
+    decoder->progress = QOI_PROGRESS_INVALID;
+    return QOI_STATUS_ERR_FORMAT;
+  }
+
+  return qoi_anim_begin_span(decoder, stream, count);
+}
 
-  // Dispatch based on the current progress.
+// Dispatch based on the current progress.
+static int qoi_dispatch(qoi_decoder_state *decoder, qoi_stream *stream) {
   switch (decoder->progress) {
     case QOI_PROGRESS_INVALID:
       return qoi_progress_invalid(decoder, stream);
@@ -416,6 +1524,8 @@ int qoi_decode(qoi_stream *stream) {
       return qoi_progress_await_channels(decoder, stream);
     case QOI_PROGRESS_AWAIT_COLORSPACE:
       return qoi_progress_await_colorspace(decoder, stream);
+    case QOI_PROGRESS_AWAIT_VERSION:
+      return qoi_progress_await_version(decoder, stream);
     case QOI_PROGRESS_NEW_PIXEL:
       return qoi_progress_new_pixel(decoder, stream);
     case QOI_PROGRESS_OP_RGBA:
@@ -424,8 +1534,203 @@ int qoi_decode(qoi_stream *stream) {
       return qoi_progress_buffered_output(decoder, stream);
     case QOI_PROGRESS_AWAIT_TAIL:
       return qoi_progress_await_tail(decoder, stream);
+    case QOI_PROGRESS_ANIM_FRAME:
+      return qoi_progress_anim_frame(decoder, stream);
+    case QOI_PROGRESS_ANIM_SKIP:
+      return qoi_progress_anim_skip(decoder, stream);
+    case QOI_PROGRESS_ANIM_COUNT:
+      return qoi_progress_anim_count(decoder, stream);
+    case QOI_PROGRESS_VALIDATE:
+      return qoi_progress_validate(decoder, stream);
+    case QOI_PROGRESS_PIXEL_DONE:
+      return qoi_progress_pixel_done(decoder, stream);
+    case QOI_PROGRESS_DONE:
+      return qoi_progress_done(decoder, stream);
     default:
       decoder->progress = QOI_PROGRESS_INVALID;
       return QOI_STATUS_ERR_INTERNAL;
   }
 }
+
+int qoi_decode(qoi_stream *stream) {
+#if __CHERIOT__
+  if (!CHERI::check_pointer<CHERI::PermissionSet{
+          CHERI::Permission::Load, CHERI::Permission::Store,
+          CHERI::Permission::LoadMutable,
+          CHERI::Permission::LoadStoreCapability}>(stream, sizeof(qoi_stream)))
+    return QOI_STATUS_ERR_PARAM;
+
+  if (stream->in_buf_size > 0 &&
+      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Store}>(
+          stream->in_buf, stream->in_buf_size))
+    return QOI_STATUS_ERR_PARAM;
+
+  // Planar output also writes to the planes after the first, and
+  // `QOI_FLAG_BLEND_DEST` reads the output as well as writing it.
+  size_t out_extent = stream->out_buf_size;
+  const uint8_t planes = qoi_format_channels(stream->format);
+  if ((stream->flags & QOI_FLAG_PLANAR) && out_extent > 0 && planes > 1)
+    out_extent += (planes - 1) * stream->plane_pitch;
+  if (out_extent > 0) {
+    if (stream->flags & QOI_FLAG_BLEND_DEST) {
+      if (!CHERI::check_pointer<CHERI::PermissionSet{
+              CHERI::Permission::Load, CHERI::Permission::Store}>(
+              stream->out_buf, out_extent))
+        return QOI_STATUS_ERR_PARAM;
+    } else if (!CHERI::check_pointer<
+                   CHERI::PermissionSet{CHERI::Permission::Store}>(
+                   stream->out_buf, out_extent)) {
+      return QOI_STATUS_ERR_PARAM;
+    }
+  }
+
+  if (stream->row_summary_size > 0 &&
+      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Load,
+                                                 CHERI::Permission::Store}>(
+          stream->row_summary, stream->row_summary_size))
+    return QOI_STATUS_ERR_PARAM;
+
+  if (stream->lut_size > 0 &&
+      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Load}>(
+          stream->lut, stream->lut_size))
+    return QOI_STATUS_ERR_PARAM;
+
+  if (stream->format == QOI_FORMAT_INDEX8 &&
+      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Load}>(
+          stream->palette_lut, QOI_PALETTE_LUT_SIZE))
+    return QOI_STATUS_ERR_PARAM;
+
+  if (stream->dictionary &&
+      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Load}>(
+          stream->dictionary, sizeof(qoi_dictionary)))
+    return QOI_STATUS_ERR_PARAM;
+#endif
+
+  if (stream->format >= QOI_FORMAT_COUNT) return QOI_STATUS_ERR_PARAM;
+  if ((stream->flags & QOI_FLAG_BLEND_DEST) &&
+      (stream->format == QOI_FORMAT_MONO1 ||
+       stream->format == QOI_FORMAT_ALPHA1 ||
+       stream->format >= QOI_FORMAT_LINEAR16 ||
+       (stream->flags & (QOI_FLAG_PLANAR | QOI_FLAG_NORMALIZE))))
+    return QOI_STATUS_ERR_PARAM;
+  if ((stream->flags & QOI_FLAG_PLANAR) &&
+      ((stream->flags & QOI_FLAG_IN_PLACE) ||
+       qoi_format_channels(stream->format) < 3))
+    return QOI_STATUS_ERR_PARAM;
+  if ((stream->flags & QOI_FLAG_NORMALIZE) &&
+      qoi_format_channels(stream->format) == 0)
+    return QOI_STATUS_ERR_PARAM;
+  if (stream->format == QOI_FORMAT_INDEX8 && !stream->palette_lut)
+    return QOI_STATUS_ERR_PARAM;
+  if ((stream->flags & QOI_FLAG_COLOR_KEY) &&
+      (stream->format == QOI_FORMAT_MONO1 ||
+       stream->format == QOI_FORMAT_ALPHA1))
+    return QOI_STATUS_ERR_PARAM;
+  if ((stream->flags & QOI_FLAG_RUNS) &&
+      (stream->format == QOI_FORMAT_MONO1 ||
+       stream->format == QOI_FORMAT_ALPHA1 ||
+       stream->format == QOI_FORMAT_LINEAR16 ||
+       stream->format == QOI_FORMAT_LINEAR32F ||
+       (stream->flags & (QOI_FLAG_PLANAR | QOI_FLAG_NORMALIZE |
+                         QOI_FLAG_BLEND_DEST | QOI_FLAG_KEY_SPANS))))
+    return QOI_STATUS_ERR_PARAM;
+  if (stream->lut_size != 0 &&
+      (!stream->lut ||
+       (stream->lut_size != 768 && stream->lut_size != 1024)))
+    return QOI_STATUS_ERR_PARAM;
+
+  qoi_decoder_state *decoder = qoi_unseal(stream->decoder_state);
+  if (!decoder) return QOI_STATUS_ERR_PARAM;
+
+#if __CHERIOT__
+  if (!CHERI::check_pointer<CHERI::PermissionSet{
+                                CHERI::Permission::Load,
+                                CHERI::Permission::Store},
+                            true, true>(decoder, sizeof(qoi_decoder_state)))
+    return QOI_STATUS_ERR_PARAM;
+#endif
+
+  // The big index is looked up afresh on every call, rather than kept
+  // from one call to the next.
+  decoder->index_big = nullptr;
+  if (stream->extended_state) {
+    qoi_extended_state *extended = qoi_unseal(stream->extended_state);
+    if (!extended) return QOI_STATUS_ERR_PARAM;
+#if __CHERIOT__
+    if (!CHERI::check_pointer<CHERI::PermissionSet{
+                                  CHERI::Permission::Load,
+                                  CHERI::Permission::Store},
+                              true, true>(extended, sizeof(qoi_extended_state)))
+      return QOI_STATUS_ERR_PARAM;
+#endif
+    decoder->index_big = extended->index_big;
+  }
+
+  const unsigned char *in_start = stream->in_buf;
+  int r = qoi_dispatch(decoder, stream);
+
+  decoder->total_in += stream->in_buf - in_start;
+  stream->total_in = decoder->total_in;
+  stream->total_pixels = decoder->total_pixels;
+  // Report the start of any partially-buffered element as the
+  // location of a format error.
+  if (r == QOI_STATUS_ERR_FORMAT)
+    stream->error_offset = decoder->total_in - decoder->tmp_buf_size;
+
+  return r;
+}
+
+int qoi_decode_resume(qoi_stream *stream, const qoi_checkpoint *checkpoint) {
+#if __CHERIOT__
+  if (!CHERI::check_pointer<CHERI::PermissionSet{
+          CHERI::Permission::Load, CHERI::Permission::Store,
+          CHERI::Permission::LoadMutable,
+          CHERI::Permission::LoadStoreCapability}>(stream, sizeof(qoi_stream)))
+    return QOI_STATUS_ERR_PARAM;
+
+  if (!CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Load}>(
+          checkpoint, sizeof(qoi_checkpoint)))
+    return QOI_STATUS_ERR_PARAM;
+#endif
+
+  // The header is not read, so check the description it would give,
+  // and that the checkpoint is within the opcodes that follow it.
+  const qoi_desc *desc = &stream->desc;
+  if (desc->width == 0 || desc->height == 0 ||
+      desc->height >= QOI_PIXELS_MAX / desc->width ||
+      (desc->channels != 3 && desc->channels != 4) ||
+      (desc->colorspace != 0 && desc->colorspace != 4) ||
+      checkpoint->pixel >= size_t(desc->width) * desc->height ||
+      checkpoint->offset < 14)
+    return QOI_STATUS_ERR_PARAM;
+
+  qoi_decoder_state *decoder = qoi_unseal(stream->decoder_state);
+  if (!decoder) return QOI_STATUS_ERR_PARAM;
+
+#if __CHERIOT__
+  if (!CHERI::check_pointer<CHERI::PermissionSet{
+                                CHERI::Permission::Load,
+                                CHERI::Permission::Store},
+                            true, true>(decoder, sizeof(qoi_decoder_state)))
+    return QOI_STATUS_ERR_PARAM;
+#endif
+
+  // Start as if the pixels before the checkpoint had just been decoded.
+  *decoder = {
+    .progress = QOI_PROGRESS_NEW_PIXEL,
+    .px_prev = checkpoint->px_prev,
+    .tmp_buf = {.v = {}},
+    .container = QOI_CONTAINER_IMAGE,
+    .profile = QOI_PROFILE_STANDARD,
+  };
+  memcpy(decoder->index, checkpoint->index, sizeof(decoder->index));
+  decoder->pixel_length_remaining =
+      size_t(desc->width) * desc->height - checkpoint->pixel;
+  decoder->column = checkpoint->pixel % desc->width;
+  decoder->row = checkpoint->pixel / desc->width;
+  decoder->checksum = 0xFFFFFFFF;
+  decoder->total_in = checkpoint->offset;
+  decoder->total_pixels = checkpoint->pixel;
+  stream->frame = 0;
+  return QOI_STATUS_DONE;
+}
@@ -2,4 +2,4 @@ compartment("qoi_decode")
     set_default(false)
     add_includedirs("../../include")
     add_deps("freestanding")
-    add_files("qoi_decode.cc")
\ No newline at end of file
+    add_files("qoi_decode.cc", "../qoi_interlace/qoi_interlace_passes.cc")
\ No newline at end of file
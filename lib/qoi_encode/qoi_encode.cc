@@ -0,0 +1,348 @@
+#include <qoi_encode.h>
+
+#ifdef __CHERIOT__
+#include <token.h>
+#include <cheri.hh>
+#include <debug.hh>
+using Debug = ConditionalDebug<true, "QOI Encoder">;
+#endif
+
+#include "qoi_encode_ops.h"
+
+static constexpr size_t QOI_PIXELS_MAX = 400000000;
+
+static constexpr uint8_t qoi_magic[4] = {'q', 'o', 'i', 'f'};
+static constexpr uint8_t qoi_extended_magic[4] = {'q', 'o', 'i', 'x'};
+static constexpr uint8_t qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+static constexpr size_t QOI_HEADER_SIZE = 14;
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+
+#ifdef __CHERIOT__
+static qoi_encoder_state *qoi_unseal(
+    qoi_encoder_state *__sealed_capability sealed) {
+  return token_unseal(STATIC_SEALING_TYPE(QOIEncoderStateKey), sealed);
+}
+
+static qoi_extended_state *qoi_unseal(
+    qoi_extended_state *__sealed_capability sealed) {
+  return token_unseal(STATIC_SEALING_TYPE(QOIExtendedStateKey), sealed);
+}
+#else
+// Provide a no-op implementation of unsealing when building for
+// non-CHERIoT.
+static qoi_encoder_state *qoi_unseal(
+    qoi_encoder_state *__sealed_capability sealed) {
+  return sealed;
+}
+
+static qoi_extended_state *qoi_unseal(
+    qoi_extended_state *__sealed_capability sealed) {
+  return sealed;
+}
+#endif
+
+int qoi_encoder_state_init(
+    qoi_encoder_state *__sealed_capability sealed_encoder) {
+  auto *encoder = qoi_unseal(sealed_encoder);
+  if (!encoder) return QOI_STATUS_ERR_PARAM;
+  *encoder = {
+    .px_prev = 0xFF000000,
+  };
+  return 0;
+}
+
+// The `QOI_PROGRESS_*` constants represent the states that the
+// encoder state machine can be in.
+static constexpr uint8_t QOI_PROGRESS_HEADER = 0;
+static constexpr uint8_t QOI_PROGRESS_PIXELS = 1;
+static constexpr uint8_t QOI_PROGRESS_TAIL = 2;
+static constexpr uint8_t QOI_PROGRESS_DONE = 3;
+static constexpr uint8_t QOI_PROGRESS_INVALID = 4;
+
+// Writes as many of the staged output bytes as fit in the output
+// buffer. Returns whether they have all been written.
+static bool qoi_drain(qoi_encoder_state *encoder, qoi_encode_stream *stream) {
+  size_t count = encoder->tmp_buf_size - encoder->tmp_buf_pos;
+  if (count > stream->out_buf_size) count = stream->out_buf_size;
+
+  memcpy(stream->out_buf, encoder->tmp_buf + encoder->tmp_buf_pos, count);
+  encoder->tmp_buf_pos += count;
+  stream->out_buf += count;
+  stream->out_buf_size -= count;
+
+  if (encoder->tmp_buf_pos < encoder->tmp_buf_size) return false;
+  encoder->tmp_buf_size = 0;
+  encoder->tmp_buf_pos = 0;
+  return true;
+}
+
+// Value of `px_raw_prev` that matches no 16-bit pixel.
+static constexpr uint32_t QOI_RAW_NONE = 0x10000;
+
+// Returns the number of bytes per pixel in `in_buf`.
+static uint8_t qoi_input_pixel_size(const qoi_encode_stream *stream) {
+  return stream->format == QOI_FORMAT_NATIVE ? stream->desc.channels : 2;
+}
+
+// Expands a `QOI_FORMAT_RGB565` or `QOI_FORMAT_BGR565` pixel to 8 bits
+// per channel by bit replication. A repeat of the previous 16-bit value
+// is recognized without expanding it again. With a `tolerance`, the
+// previous pixel as decoded is within it of the repeat, so still stands
+// in for it.
+static uint32_t qoi_expand_565(qoi_encoder_state *encoder,
+                               const qoi_ops_state *ops, uint8_t format,
+                               uint16_t v) {
+  if (v == encoder->px_raw_prev) return ops->px_prev;
+  encoder->px_raw_prev = v;
+
+  if (format == QOI_FORMAT_BGR565) v = __builtin_bswap16(v);
+  uint32_t r = v >> 11;
+  uint32_t g = (v >> 5) & 0x3F;
+  uint32_t b = v & 0x1F;
+  if (format == QOI_FORMAT_BGR565) {
+    uint32_t t = r;
+    r = b;
+    b = t;
+  }
+  r = r << 3 | r >> 2;
+  g = g << 2 | g >> 4;
+  b = b << 3 | b >> 2;
+  return 0xFF000000 | b << 16 | g << 8 | r;
+}
+
+static int qoi_progress_pixels(qoi_encoder_state *, qoi_ops_state *,
+                               qoi_encode_stream *);
+static int qoi_progress_tail(qoi_encoder_state *, qoi_encode_stream *);
+
+static int qoi_progress_header(qoi_encoder_state *encoder, qoi_ops_state *ops,
+                               qoi_encode_stream *stream) {
+  const qoi_desc *desc = &stream->desc;
+  if (desc->width == 0 || desc->height == 0 ||
+      desc->height >= QOI_PIXELS_MAX / desc->width ||
+      (desc->channels != 3 && desc->channels != 4) ||
+      (desc->colorspace != 0 && desc->colorspace != 4) ||
+      (stream->format != QOI_FORMAT_NATIVE &&
+       ((stream->format != QOI_FORMAT_RGB565 &&
+         stream->format != QOI_FORMAT_BGR565) ||
+        desc->channels != 3)) ||
+      (stream->in_stride != 0 &&
+       stream->in_stride < size_t(desc->width) *
+                               qoi_input_pixel_size(stream)) ||
+      stream->profile > QOI_PROFILE_EXTENDED ||
+      (stream->profile == QOI_PROFILE_EXTENDED && !ops->index_big)) {
+    encoder->progress = QOI_PROGRESS_INVALID;
+    return QOI_STATUS_ERR_PARAM;
+  }
+
+  uint32_t width = __builtin_bswap32(desc->width);
+  uint32_t height = __builtin_bswap32(desc->height);
+  const bool extended = stream->profile == QOI_PROFILE_EXTENDED;
+  static_assert(QOI_HEADER_SIZE + 1 <= sizeof(encoder->tmp_buf));
+  memcpy(encoder->tmp_buf, extended ? qoi_extended_magic : qoi_magic, 4);
+  memcpy(encoder->tmp_buf + 4, &width, 4);
+  memcpy(encoder->tmp_buf + 8, &height, 4);
+  encoder->tmp_buf[12] = desc->channels;
+  encoder->tmp_buf[13] = desc->colorspace;
+  encoder->tmp_buf_size = QOI_HEADER_SIZE;
+  if (extended)
+    encoder->tmp_buf[encoder->tmp_buf_size++] = QOI_PROFILE_VERSION;
+  encoder->pixel_length_remaining = size_t(desc->width) * desc->height;
+
+  if (stream->dictionary) {
+    qoi_dictionary_load(stream->dictionary, &ops->px_prev, ops->index);
+    // No 16-bit value is known to expand to the previous pixel.
+    encoder->px_raw_prev = QOI_RAW_NONE;
+  }
+  if (extended) qoi_ops_init_big(ops);
+
+  return qoi_progress_pixels(encoder, ops, stream);
+}
+
+static int qoi_progress_pixels(qoi_encoder_state *encoder, qoi_ops_state *ops,
+                               qoi_encode_stream *stream) {
+  encoder->progress = QOI_PROGRESS_PIXELS;
+  const uint8_t format = stream->format;
+  const uint8_t size = qoi_input_pixel_size(stream);
+  uint32_t tolerance;
+  memcpy(&tolerance, stream->tolerance, 4);
+  const bool near = tolerance != 0;
+  const size_t padding =
+      stream->in_stride ? stream->in_stride - size_t(stream->desc.width) * size
+                        : 0;
+
+  // Pixels are encoded in a loop rather than by recursing through the
+  // states, so that the stack depth does not depend on the input size.
+  while (true) {
+    if (!qoi_drain(encoder, stream)) return QOI_STATUS_OUTPUT_EXHAUSTED;
+    if (encoder->pixel_length_remaining == 0) break;
+
+    // Skip the padding after the previous row, which may be split
+    // across input buffers.
+    if (encoder->padding_remaining > 0) {
+      size_t count = encoder->padding_remaining;
+      if (count > stream->in_buf_size) count = stream->in_buf_size;
+      stream->in_buf += count;
+      stream->in_buf_size -= count;
+      encoder->padding_remaining -= count;
+      if (encoder->padding_remaining > 0) return QOI_STATUS_INPUT_EXHAUSTED;
+    }
+
+    // Read the next pixel, gathering it in `px_buf` if it is split
+    // across input buffers.
+    uint32_t pixel = 0xFF000000;
+    if (encoder->px_buf_size == 0 && stream->in_buf_size >= size) {
+      memcpy(&pixel, stream->in_buf, size);
+      stream->in_buf += size;
+      stream->in_buf_size -= size;
+    } else {
+      size_t count = size - encoder->px_buf_size;
+      if (count > stream->in_buf_size) count = stream->in_buf_size;
+      memcpy(encoder->px_buf.b + encoder->px_buf_size, stream->in_buf,
+             count);
+      encoder->px_buf_size += count;
+      stream->in_buf += count;
+      stream->in_buf_size -= count;
+      if (encoder->px_buf_size < size) return QOI_STATUS_INPUT_EXHAUSTED;
+
+      memcpy(&pixel, encoder->px_buf.b, size);
+      encoder->px_buf_size = 0;
+    }
+    if (format != QOI_FORMAT_NATIVE)
+      pixel = qoi_expand_565(encoder, ops, format, pixel);
+    encoder->pixel_length_remaining -= 1;
+
+    if (++encoder->column == stream->desc.width) {
+      encoder->column = 0;
+      if (encoder->pixel_length_remaining > 0)
+        encoder->padding_remaining = padding;
+    }
+
+    // Encode straight into the output buffer when there is room for
+    // the largest possible result, and stage the bytes otherwise.
+    unsigned char *out = encoder->tmp_buf;
+    const bool direct = stream->out_buf_size > QOI_OPS_PIXEL_SIZE_MAX;
+    if (direct) out = stream->out_buf;
+
+    size_t n = near ? qoi_ops_push_near(ops, pixel, stream->tolerance, out)
+                    : qoi_ops_push(ops, pixel, out);
+    // The last pixel ends any run.
+    if (encoder->pixel_length_remaining == 0)
+      n += qoi_ops_flush_run(ops, out + n);
+
+    if (direct) {
+      stream->out_buf += n;
+      stream->out_buf_size -= n;
+    } else {
+      encoder->tmp_buf_size = n;
+    }
+  }
+
+  return qoi_progress_tail(encoder, stream);
+}
+
+static int qoi_progress_tail(qoi_encoder_state *encoder,
+                             qoi_encode_stream *stream) {
+  if (encoder->progress != QOI_PROGRESS_TAIL) {
+    encoder->progress = QOI_PROGRESS_TAIL;
+    memcpy(encoder->tmp_buf, qoi_padding, sizeof(qoi_padding));
+    encoder->tmp_buf_size = sizeof(qoi_padding);
+  }
+
+  if (!qoi_drain(encoder, stream)) return QOI_STATUS_OUTPUT_EXHAUSTED;
+
+  encoder->progress = QOI_PROGRESS_DONE;
+  return QOI_STATUS_DONE;
+}
+
+static int qoi_dispatch(qoi_encoder_state *encoder, qoi_ops_state *ops,
+                        qoi_encode_stream *stream) {
+  switch (encoder->progress) {
+    case QOI_PROGRESS_HEADER:
+      return qoi_progress_header(encoder, ops, stream);
+    case QOI_PROGRESS_PIXELS:
+      return qoi_progress_pixels(encoder, ops, stream);
+    case QOI_PROGRESS_TAIL:
+      return qoi_progress_tail(encoder, stream);
+    case QOI_PROGRESS_DONE:
+      // Further calls have no effect until the encoder is
+      // re-initialized.
+      return QOI_STATUS_DONE;
+    case QOI_PROGRESS_INVALID:
+      return QOI_STATUS_ERR_PARAM;
+    default:
+      encoder->progress = QOI_PROGRESS_INVALID;
+      return QOI_STATUS_ERR_INTERNAL;
+  }
+}
+
+int qoi_encode(qoi_encode_stream *stream) {
+#if __CHERIOT__
+  if (!CHERI::check_pointer<CHERI::PermissionSet{
+          CHERI::Permission::Load, CHERI::Permission::Store,
+          CHERI::Permission::LoadMutable,
+          CHERI::Permission::LoadStoreCapability}>(stream,
+                                                   sizeof(qoi_encode_stream)))
+    return QOI_STATUS_ERR_PARAM;
+
+  if (stream->in_buf_size > 0 &&
+      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Load}>(
+          stream->in_buf, stream->in_buf_size))
+    return QOI_STATUS_ERR_PARAM;
+
+  if (stream->out_buf_size > 0 &&
+      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Store}>(
+          stream->out_buf, stream->out_buf_size))
+    return QOI_STATUS_ERR_PARAM;
+
+  if (stream->dictionary &&
+      !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Load}>(
+          stream->dictionary, sizeof(qoi_dictionary)))
+    return QOI_STATUS_ERR_PARAM;
+#endif
+
+  qoi_encoder_state *encoder = qoi_unseal(stream->encoder_state);
+  if (!encoder) return QOI_STATUS_ERR_PARAM;
+
+#if __CHERIOT__
+  if (!CHERI::check_pointer<CHERI::PermissionSet{
+                                CHERI::Permission::Load,
+                                CHERI::Permission::Store},
+                            true, true>(encoder, sizeof(qoi_encoder_state)))
+    return QOI_STATUS_ERR_PARAM;
+#endif
+
+  qoi_extended_state *extended = nullptr;
+  if (stream->profile == QOI_PROFILE_EXTENDED && stream->extended_state) {
+    extended = qoi_unseal(stream->extended_state);
+    if (!extended) return QOI_STATUS_ERR_PARAM;
+#if __CHERIOT__
+    if (!CHERI::check_pointer<CHERI::PermissionSet{
+                                  CHERI::Permission::Load,
+                                  CHERI::Permission::Store},
+                              true, true>(extended, sizeof(qoi_extended_state)))
+      return QOI_STATUS_ERR_PARAM;
+#endif
+  }
+
+  // The opcode engine works on its own copy of the prediction state
+  // for the duration of the call.
+  qoi_ops_state ops;
+  ops.px_prev = encoder->px_prev;
+  memcpy(ops.index, encoder->index, sizeof(ops.index));
+  ops.run = encoder->run;
+  ops.index_big = extended ? extended->index_big : nullptr;
+
+  const unsigned char *in_start = stream->in_buf;
+  const unsigned char *out_start = stream->out_buf;
+  int r = qoi_dispatch(encoder, &ops, stream);
+
+  encoder->px_prev = ops.px_prev;
+  memcpy(encoder->index, ops.index, sizeof(encoder->index));
+  encoder->run = ops.run;
+
+  encoder->total_in += stream->in_buf - in_start;
+  encoder->total_out += stream->out_buf - out_start;
+  stream->total_in = encoder->total_in;
+  stream->total_out = encoder->total_out;
+  return r;
+}
@@ -0,0 +1,409 @@
+#include <qoi_encode_host.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "qoi_encode_ops.h"
+
+static constexpr size_t QOI_PIXELS_MAX = 400000000;
+
+static constexpr uint8_t qoi_magic[4] = {'q', 'o', 'i', 'f'};
+static constexpr uint8_t qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+static constexpr size_t QOI_HEADER_SIZE = 14;
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+
+// Encoder state for a stretch of pixels. A band of an image encoded
+// before the bands above it knows its previous pixel but not `index`,
+// so slots it has not written itself are treated as misses. Each such
+// miss is recorded, to be turned into a `QOI_OP_INDEX` when stitching
+// if the real `index` would have hit. Either way, `index` ends up the
+// same, so nothing after the miss depends on it.
+struct qoi_miss {
+  unsigned char *at;
+  uint32_t pixel;
+  uint8_t slot;
+  uint8_t size;
+};
+
+struct qoi_band {
+  qoi_ops_state ops;
+  // The `index` slots that have been written.
+  uint64_t known;
+  qoi_miss misses[64];
+  size_t miss_count;
+};
+
+// Records that the `size` bytes at `at` encode a miss of `pixel` in an
+// unknown slot.
+static void qoi_band_miss(qoi_band *band, uint32_t pixel, uint8_t slot,
+                          unsigned char *at, size_t size) {
+  band->known |= uint64_t(1) << slot;
+  band->misses[band->miss_count++] = {at, pixel, slot, uint8_t(size)};
+}
+
+// Like `qoi_ops_push`, but only hits known slots of `index`.
+static size_t qoi_band_push(qoi_band *band, uint32_t pixel,
+                            unsigned char *out) {
+  qoi_ops_state *ops = &band->ops;
+  const size_t slot = qoi_ops_hash(pixel);
+  if (pixel == ops->px_prev || band->known >> slot & 1)
+    return qoi_ops_push(ops, pixel, out);
+
+  const size_t flush = ops->run > 0;
+  ops->index[slot] = ~pixel;
+  size_t n = qoi_ops_push(ops, pixel, out);
+  qoi_band_miss(band, pixel, slot, out + flush, n - flush);
+  return n;
+}
+
+// Number of pixels classified together.
+static constexpr size_t QOI_BLOCK_SIZE = 8;
+
+#if defined(__AVX2__)
+// A block of pixels with everything about them that depends only on
+// each pixel and its predecessor. `same` and `alpha_same` have bit `i`
+// set when pixel `i` is equal to its predecessor or has the same alpha.
+// For the pixels with the same alpha, `code` holds the smallest of the
+// `QOI_OP_DIFF`, `QOI_OP_LUMA` and `QOI_OP_RGB` encodings and `size`
+// its length in bytes.
+struct qoi_block {
+  uint32_t pixels[QOI_BLOCK_SIZE];
+  uint32_t code[QOI_BLOCK_SIZE];
+  uint32_t size[QOI_BLOCK_SIZE];
+  uint32_t hash[QOI_BLOCK_SIZE];
+  uint8_t same;
+  uint8_t alpha_same;
+};
+
+// Classifies a whole block of pixels, already loaded as `cur`.
+static void qoi_classify_avx2(qoi_block *block, __m256i cur, uint32_t prev) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i three = _mm256_set1_epi32(3);
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(block->pixels), cur);
+
+  // Each pixel's predecessor: the vector shifted by one pixel, with
+  // the last pixel of the previous block first.
+  __m256i shifted = _mm256_permutevar8x32_epi32(
+      cur, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+  __m256i old = _mm256_blend_epi32(shifted, _mm256_set1_epi32(prev), 1);
+
+  auto mask = [](__m256i v) {
+    return uint8_t(_mm256_movemask_ps(_mm256_castsi256_ps(v)));
+  };
+  block->same = mask(_mm256_cmpeq_epi32(cur, old));
+
+  // All tests are on the wrapping byte differences. Each is biased so
+  // that the values that fit have only the bits kept by the mask clear,
+  // leaving the fields of the opcode in the low bits.
+  __m256i d = _mm256_sub_epi8(cur, old);
+  block->alpha_same = mask(_mm256_cmpeq_epi32(
+      _mm256_and_si256(d, _mm256_set1_epi32(0xFF000000)), zero));
+
+  __m256i diff = _mm256_add_epi8(d, _mm256_set1_epi32(0x00020202));
+  __m256i is_diff = _mm256_cmpeq_epi32(
+      _mm256_and_si256(diff, _mm256_set1_epi32(0xFFFCFCFC)), zero);
+  __m256i diff_code = _mm256_or_si256(
+      _mm256_or_si256(_mm256_set1_epi32(0b01000000),
+                      _mm256_slli_epi32(_mm256_and_si256(diff, three), 4)),
+      _mm256_or_si256(
+          _mm256_and_si256(_mm256_srli_epi32(diff, 6), _mm256_set1_epi32(0xC)),
+          _mm256_and_si256(_mm256_srli_epi32(diff, 16), three)));
+
+  // Subtract the green difference from the red and blue ones.
+  const __m256i green = _mm256_setr_epi8(
+      1, -1, 1, -1, 5, -1, 5, -1, 9, -1, 9, -1, 13, -1, 13, -1,
+      1, -1, 1, -1, 5, -1, 5, -1, 9, -1, 9, -1, 13, -1, 13, -1);
+  __m256i luma = _mm256_sub_epi8(d, _mm256_shuffle_epi8(d, green));
+  luma = _mm256_add_epi8(luma, _mm256_set1_epi32(0x00082008));
+  __m256i is_luma = _mm256_cmpeq_epi32(
+      _mm256_and_si256(luma, _mm256_set1_epi32(0xFFF0C0F0)), zero);
+  __m256i luma_code = _mm256_or_si256(
+      _mm256_or_si256(_mm256_set1_epi32(0b10000000),
+                      _mm256_and_si256(_mm256_srli_epi32(luma, 8),
+                                       _mm256_set1_epi32(0x0F3F))),
+      _mm256_and_si256(_mm256_slli_epi32(luma, 12),
+                       _mm256_set1_epi32(0xF000)));
+
+  __m256i rgb_code =
+      _mm256_or_si256(_mm256_slli_epi32(cur, 8), _mm256_set1_epi32(0b11111110));
+
+  __m256i code = _mm256_blendv_epi8(rgb_code, luma_code, is_luma);
+  code = _mm256_blendv_epi8(code, diff_code, is_diff);
+  __m256i size = _mm256_blendv_epi8(_mm256_set1_epi32(4),
+                                    _mm256_set1_epi32(2), is_luma);
+  size = _mm256_blendv_epi8(size, _mm256_set1_epi32(1), is_diff);
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(block->code), code);
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(block->size), size);
+
+  // r * 3 + g * 5 + b * 7 + a * 11, as pairs of 16-bit sums.
+  __m256i sums = _mm256_maddubs_epi16(cur, _mm256_set1_epi32(0x0B070503));
+  sums = _mm256_madd_epi16(sums, _mm256_set1_epi16(1));
+  sums = _mm256_and_si256(sums, _mm256_set1_epi32(63));
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(block->hash), sums);
+}
+
+// Loads and classifies the block starting at pixel `start`, unless
+// there are too few pixels left to load as a vector.
+static bool qoi_load_block(qoi_block *block, const unsigned char *pixels,
+                           size_t start, size_t length, uint8_t channels,
+                           uint32_t prev) {
+  if (channels == 4) {
+    if (start + QOI_BLOCK_SIZE > length) return false;
+    __m256i cur = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(pixels + start * 4));
+    qoi_classify_avx2(block, cur, prev);
+    return true;
+  }
+
+  // Expanding 3-channel pixels reads 8 bytes past the block.
+  if ((start + QOI_BLOCK_SIZE) * 3 + 8 > length * 3) return false;
+  __m256i raw = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i *>(pixels + start * 3));
+  raw = _mm256_permutevar8x32_epi32(raw,
+                                    _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0));
+  const __m256i expand = _mm256_setr_epi8(
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  __m256i cur = _mm256_or_si256(_mm256_shuffle_epi8(raw, expand),
+                                _mm256_set1_epi32(0xFF000000));
+  qoi_classify_avx2(block, cur, prev);
+  return true;
+}
+
+// Emits the opcodes for a classified block. Only the `index` lookups
+// and run counting remain serial.
+static size_t qoi_encode_block(qoi_band *band, const qoi_block *block,
+                               unsigned char *out) {
+  qoi_ops_state *ops = &band->ops;
+  // A block that only continues a run is the common case in flat areas.
+  if (block->same == 0xFF && ops->run + QOI_BLOCK_SIZE < 62) {
+    ops->run += QOI_BLOCK_SIZE;
+    return 0;
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < QOI_BLOCK_SIZE; ++i) {
+    const uint32_t pixel = block->pixels[i];
+    const uint8_t bit = 1 << i;
+
+    if (block->same & bit) {
+      ops->run += 1;
+      if (ops->run == 62) n += qoi_ops_flush_run(ops, out + n);
+      continue;
+    }
+    n += qoi_ops_flush_run(ops, out + n);
+
+    const uint8_t slot = block->hash[i];
+    const bool known = band->known >> slot & 1;
+    if (known && ops->index[slot] == pixel) {
+      // QOI_OP_INDEX
+      out[n++] = slot;
+      continue;
+    }
+    ops->index[slot] = pixel;
+
+    const size_t start = n;
+    if (block->alpha_same & bit) {
+      // Room for the whole of `code` is left by the tail.
+      memcpy(out + n, &block->code[i], 4);
+      n += block->size[i];
+    } else {
+      // QOI_OP_RGBA
+      out[n++] = 0b11111111;
+      memcpy(out + n, &pixel, 4);
+      n += 4;
+    }
+    if (!known) qoi_band_miss(band, pixel, slot, out + start, n - start);
+  }
+  ops->px_prev = block->pixels[QOI_BLOCK_SIZE - 1];
+  return n;
+}
+#endif
+
+// Encodes pixels `start` to `end` with `band`, returning the number of
+// bytes written to `out`. Any run is left pending.
+static size_t qoi_band_encode(qoi_band *band, const unsigned char *pixels,
+                              size_t start, size_t end, uint8_t channels,
+                              unsigned char *out) {
+  size_t n = 0;
+  size_t i = start;
+#if defined(__AVX2__)
+  qoi_block block;
+  for (; qoi_load_block(&block, pixels, i, end, channels, band->ops.px_prev);
+       i += QOI_BLOCK_SIZE)
+    n += qoi_encode_block(band, &block, out + n);
+#endif
+  // Whatever is left is encoded one pixel at a time.
+  if (channels == 4) {
+    for (; i < end; ++i) {
+      uint32_t pixel;
+      memcpy(&pixel, pixels + i * 4, 4);
+      n += qoi_band_push(band, pixel, out + n);
+    }
+  }
+  for (; i < end; ++i) {
+    uint32_t pixel = 0xFF000000;
+    memcpy(&pixel, pixels + i * 3, 3);
+    n += qoi_band_push(band, pixel, out + n);
+  }
+  return n;
+}
+
+// Writes the header for `desc` to `out`, returning its size, or 0 if
+// `desc` or `out_size` is invalid.
+static size_t qoi_write_header(const qoi_desc *desc, unsigned char *out,
+                               size_t out_size) {
+  if (desc->width == 0 || desc->height == 0 ||
+      desc->height >= QOI_PIXELS_MAX / desc->width ||
+      (desc->channels != 3 && desc->channels != 4) ||
+      (desc->colorspace != 0 && desc->colorspace != 4))
+    return 0;
+  // Every pixel takes at most `channels + 1` bytes, counting the byte
+  // that ends a run against the pixels in it, so this is all the
+  // checking the output needs.
+  if (out_size < QOI_ENCODE_SIZE_MAX(desc)) return 0;
+
+  uint32_t width = __builtin_bswap32(desc->width);
+  uint32_t height = __builtin_bswap32(desc->height);
+  memcpy(out, qoi_magic, 4);
+  memcpy(out + 4, &width, 4);
+  memcpy(out + 8, &height, 4);
+  out[12] = desc->channels;
+  out[13] = desc->colorspace;
+  return QOI_HEADER_SIZE;
+}
+
+size_t qoi_encode_host(const qoi_desc *desc, const unsigned char *pixels,
+                       unsigned char *out, size_t out_size) {
+  size_t n = qoi_write_header(desc, out, out_size);
+  if (n == 0) return 0;
+
+  // The whole image is one band, which knows its initial state.
+  qoi_band band;
+  qoi_ops_init(&band.ops);
+  band.known = ~uint64_t(0);
+  band.miss_count = 0;
+  const size_t length = size_t(desc->width) * desc->height;
+  n += qoi_band_encode(&band, pixels, 0, length, desc->channels, out + n);
+  n += qoi_ops_flush_run(&band.ops, out + n);
+
+  memcpy(out + n, qoi_padding, sizeof(qoi_padding));
+  return n + sizeof(qoi_padding);
+}
+
+namespace {
+// One band of an image being encoded in parallel.
+struct qoi_band_job {
+  qoi_band band;
+  size_t start;
+  size_t end;
+  // Number of pixels at the start of the band that are equal to the
+  // last one before it. They continue whatever run the previous band
+  // ends with, so are left to the stitching.
+  size_t lead;
+  std::vector<unsigned char> out;
+  size_t size;
+};
+}  // namespace
+
+size_t qoi_encode_host_parallel(const qoi_desc *desc,
+                                const unsigned char *pixels,
+                                unsigned char *out, size_t out_size,
+                                uint32_t bands, uint32_t threads,
+                                qoi_checkpoint *checkpoints) {
+  size_t n = qoi_write_header(desc, out, out_size);
+  if (n == 0 || bands == 0) return 0;
+  if (bands > desc->height) bands = desc->height;
+  const uint8_t channels = desc->channels;
+
+  std::vector<qoi_band_job> jobs(bands);
+  auto encode_band = [&](uint32_t k) {
+    qoi_band_job *job = &jobs[k];
+    job->start = size_t(desc->width) * (uint64_t(desc->height) * k / bands);
+    job->end =
+        size_t(desc->width) * (uint64_t(desc->height) * (k + 1) / bands);
+
+    // Only the previous pixel is known at the start of the band.
+    uint32_t prev = 0xFF000000;
+    if (job->start > 0)
+      memcpy(&prev, pixels + (job->start - 1) * channels, channels);
+    job->lead = 0;
+    for (size_t i = job->start; i < job->end; ++i, ++job->lead) {
+      uint32_t pixel = 0xFF000000;
+      memcpy(&pixel, pixels + i * channels, channels);
+      if (pixel != prev) break;
+    }
+
+    qoi_ops_init(&job->band.ops);
+    job->band.ops.px_prev = prev;
+    job->band.known = 0;
+    job->band.miss_count = 0;
+    const size_t begin = job->start + job->lead;
+    job->out.resize((job->end - begin) * (channels + 1) + 8);
+    job->size = qoi_band_encode(&job->band, pixels, begin, job->end,
+                                channels, job->out.data());
+  };
+
+  // The bands are shared out among a pool of threads, including this one.
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads > bands) threads = bands;
+  std::atomic<uint32_t> next{0};
+  auto worker = [&] {
+    for (uint32_t k; (k = next.fetch_add(1)) < bands;) encode_band(k);
+  };
+  std::vector<std::thread> pool;
+  for (uint32_t t = 1; t < threads; ++t) pool.emplace_back(worker);
+  worker();
+  for (std::thread &thread : pool) thread.join();
+
+  // Stitch the bands together in order, carrying the real state from
+  // one to the next.
+  qoi_ops_state state;
+  qoi_ops_init(&state);
+  for (qoi_band_job &job : jobs) {
+    if (checkpoints) {
+      // The pending run is decoded from the band's first bytes.
+      qoi_checkpoint *checkpoint = &checkpoints[&job - jobs.data()];
+      checkpoint->offset = n;
+      checkpoint->pixel = job.start - state.run;
+      checkpoint->px_prev = state.px_prev;
+      memcpy(checkpoint->index, state.index, sizeof(state.index));
+    }
+
+    size_t run = state.run + job.lead;
+    for (; run >= 62; run -= 62) out[n++] = 0b11000000 | 61;
+    state.run = run;
+    if (job.start + job.lead == job.end) continue;
+    n += qoi_ops_flush_run(&state, out + n);
+
+    // Copy the band, turning the misses that the real `index` would
+    // have hit into `QOI_OP_INDEX`.
+    const unsigned char *src = job.out.data();
+    for (size_t i = 0; i < job.band.miss_count; ++i) {
+      const qoi_miss *miss = &job.band.misses[i];
+      if (state.index[miss->slot] != miss->pixel) continue;
+      memcpy(out + n, src, miss->at - src);
+      n += miss->at - src;
+      out[n++] = miss->slot;
+      src = miss->at + miss->size;
+    }
+    const unsigned char *band_end = job.out.data() + job.size;
+    memcpy(out + n, src, band_end - src);
+    n += band_end - src;
+
+    for (size_t slot = 0; slot < 64; ++slot)
+      if (job.band.known >> slot & 1)
+        state.index[slot] = job.band.ops.index[slot];
+    state.px_prev = job.band.ops.px_prev;
+    state.run = job.band.ops.run;
+  }
+  n += qoi_ops_flush_run(&state, out + n);
+
+  memcpy(out + n, qoi_padding, sizeof(qoi_padding));
+  return n + sizeof(qoi_padding);
+}
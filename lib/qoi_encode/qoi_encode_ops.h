@@ -0,0 +1,238 @@
+#pragma once
+
+// The QOI opcode engine shared by the encoders. It turns a sequence of
+// pixels into QOI opcodes while tracking the same previous pixel and
+// `index` state that `qoi_decode` reconstructs from them.
+
+#include <qoi_decode.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The largest number of bytes emitted for a single pixel: a flushed
+// `QOI_OP_RUN_LONG` followed by a `QOI_OP_RGBA`.
+static constexpr size_t QOI_OPS_PIXEL_SIZE_MAX = 8;
+
+// Longest runs that a single `QOI_OP_RUN` and `QOI_OP_RUN_LONG` can
+// encode in the extended profile.
+static constexpr uint32_t QOI_OPS_RUN_SHORT_MAX = QOI_RUN_LONG_MIN - 1;
+static constexpr uint32_t QOI_OPS_RUN_LONG_MAX = QOI_RUN_LONG_MIN + 0xFFFF;
+
+// Pixels are handled as `uint32_t`s holding the R, G, B and A bytes
+// in memory order, matching the decoder.
+typedef struct {
+  uint32_t px_prev;
+  uint32_t index[64];
+  uint32_t run;
+  // The big index of `QOI_PROFILE_EXTENDED`, or NULL to emit standard
+  // QOI opcodes only.
+  uint32_t *index_big;
+} qoi_ops_state;
+
+static inline void qoi_ops_init(qoi_ops_state *ops) {
+  *ops = {
+    .px_prev = 0xFF000000,
+  };
+}
+
+// Returns the slot of a pixel in the big index.
+static inline size_t qoi_ops_hash_big(uint32_t pixel) {
+  return qoi_pixel_hash(pixel) % 256;
+}
+
+static inline size_t qoi_ops_hash(uint32_t pixel) {
+  return qoi_ops_hash_big(pixel) % 64;
+}
+
+// Starts the big index off as the decoder does, holding only the
+// previous pixel.
+static inline void qoi_ops_init_big(qoi_ops_state *ops) {
+  memset(ops->index_big, 0, sizeof(qoi_extended_state::index_big));
+  ops->index_big[qoi_ops_hash_big(ops->px_prev)] = ops->px_prev;
+}
+
+// Emits the pending `QOI_OP_RUN` or `QOI_OP_RUN_LONG`, if any.
+static inline size_t qoi_ops_flush_run(qoi_ops_state *ops,
+                                       unsigned char *out) {
+  if (ops->run == 0) return 0;
+  size_t n = 0;
+  if (ops->index_big) {
+    // A `QOI_OP_RUN_LONG` only pays off over three `QOI_OP_RUN`s.
+    if (ops->run > 3 * QOI_OPS_RUN_SHORT_MAX) {
+      uint32_t count = ops->run - QOI_RUN_LONG_MIN;
+      out[0] = QOI_OP_RUN_LONG;
+      out[1] = count >> 8;
+      out[2] = count;
+      ops->run = 0;
+      return 3;
+    }
+    for (; ops->run > QOI_OPS_RUN_SHORT_MAX; ops->run -= QOI_OPS_RUN_SHORT_MAX)
+      out[n++] = 0b11000000 | (QOI_OPS_RUN_SHORT_MAX - 1);
+  }
+  out[n++] = 0b11000000 | (ops->run - 1);
+  ops->run = 0;
+  return n;
+}
+
+// Encodes one pixel, returning the number of bytes written to `out`,
+// which must have room for `QOI_OPS_PIXEL_SIZE_MAX` bytes. Runs are
+// only emitted once they reach their maximum length, or when flushed
+// by the next differing pixel or `qoi_ops_flush_run`.
+static inline size_t qoi_ops_push(qoi_ops_state *ops, uint32_t pixel,
+                                  unsigned char *out) {
+  if (pixel == ops->px_prev) {
+    ops->run += 1;
+    if (ops->run == (ops->index_big ? QOI_OPS_RUN_LONG_MAX : 62))
+      return qoi_ops_flush_run(ops, out);
+    return 0;
+  }
+
+  size_t n = qoi_ops_flush_run(ops, out);
+
+  // The big index is updated with every pixel, as by the decoder.
+  bool big_hit = false;
+  size_t big = 0;
+  if (ops->index_big) {
+    big = qoi_ops_hash_big(pixel);
+    big_hit = ops->index_big[big] == pixel;
+    ops->index_big[big] = pixel;
+  }
+
+  size_t idx = qoi_ops_hash(pixel);
+  if (ops->index[idx] == pixel) {
+    // QOI_OP_INDEX
+    out[n++] = idx;
+    ops->px_prev = pixel;
+    return n;
+  }
+  ops->index[idx] = pixel;
+
+  uint8_t cur[4], prev[4];
+  memcpy(cur, &pixel, 4);
+  memcpy(prev, &ops->px_prev, 4);
+  ops->px_prev = pixel;
+
+  if (cur[3] != prev[3] && big_hit) {
+    // QOI_OP_INDEX_BIG
+    out[n++] = QOI_OP_INDEX_BIG;
+    out[n++] = big;
+    return n;
+  } else if (cur[3] != prev[3]) {
+    // QOI_OP_RGBA
+    out[n++] = 0b11111111;
+    memcpy(out + n, cur, 4);
+    return n + 4;
+  }
+
+  int8_t vr = cur[0] - prev[0];
+  int8_t vg = cur[1] - prev[1];
+  int8_t vb = cur[2] - prev[2];
+  int8_t vg_r = vr - vg;
+  int8_t vg_b = vb - vg;
+
+  if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+    // QOI_OP_DIFF
+    out[n++] = 0b01000000 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+  } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 &&
+             vg_b < 8) {
+    // QOI_OP_LUMA
+    out[n++] = 0b10000000 | (vg + 32);
+    out[n++] = (vg_r + 8) << 4 | (vg_b + 8);
+  } else if (big_hit) {
+    // QOI_OP_INDEX_BIG
+    out[n++] = QOI_OP_INDEX_BIG;
+    out[n++] = big;
+  } else {
+    // QOI_OP_RGB
+    out[n++] = 0b11111110;
+    memcpy(out + n, cur, 3);
+    n += 3;
+  }
+  return n;
+}
+
+// Returns whether each channel of `a` is within `tolerance` of `b`.
+static inline bool qoi_ops_within(uint32_t a, uint32_t b,
+                                  const uint8_t tolerance[4]) {
+  uint8_t x[4], y[4];
+  memcpy(x, &a, 4);
+  memcpy(y, &b, 4);
+  for (int k = 0; k < 4; ++k) {
+    int d = x[k] - y[k];
+    if (d < -tolerance[k] || d > tolerance[k]) return false;
+  }
+  return true;
+}
+
+// Returns the total error of `a` as an approximation of `b`.
+static inline int qoi_ops_error(uint32_t a, uint32_t b) {
+  uint8_t x[4], y[4];
+  memcpy(x, &a, 4);
+  memcpy(y, &b, 4);
+  int error = 0;
+  for (int k = 0; k < 4; ++k) error += x[k] > y[k] ? x[k] - y[k] : y[k] - x[k];
+  return error;
+}
+
+static inline int qoi_ops_clamp(int v, int lo, int hi) {
+  return v < lo ? lo : v > hi ? hi : v;
+}
+
+// Like `qoi_ops_push`, but encodes whichever pixel within `tolerance` of
+// `pixel` in each channel is cheapest: the previous pixel, extending a
+// run, then an `index` entry or a `QOI_OP_DIFF` step, then a
+// `QOI_OP_LUMA` step. The chosen pixel is pushed as it will be decoded,
+// so each pixel's error is bounded on its own and does not accumulate.
+static inline size_t qoi_ops_push_near(qoi_ops_state *ops, uint32_t pixel,
+                                       const uint8_t tolerance[4],
+                                       unsigned char *out) {
+  const uint32_t px_prev = ops->px_prev;
+  if (qoi_ops_within(pixel, px_prev, tolerance))
+    return qoi_ops_push(ops, px_prev, out);
+  if (ops->index[qoi_ops_hash(pixel)] == pixel)
+    return qoi_ops_push(ops, pixel, out);
+
+  uint8_t cur[4], prev[4];
+  memcpy(cur, &pixel, 4);
+  memcpy(prev, &px_prev, 4);
+  // Every other opcode keeps the previous alpha.
+  if (!qoi_ops_within(pixel & 0xFF000000, px_prev & 0xFF000000, tolerance))
+    return qoi_ops_push(ops, pixel, out);
+
+  // The closest one-byte encoding, if any.
+  uint32_t best = pixel;
+  int best_error = -1;
+  auto consider = [&](uint32_t candidate) {
+    if (!qoi_ops_within(candidate, pixel, tolerance)) return;
+    int error = qoi_ops_error(candidate, pixel);
+    if (best_error < 0 || error < best_error) {
+      best = candidate;
+      best_error = error;
+    }
+  };
+
+  uint8_t step[4];
+  step[3] = prev[3];
+  for (int k = 0; k < 3; ++k)
+    step[k] = prev[k] + qoi_ops_clamp(cur[k] - prev[k], -2, 1);
+  uint32_t candidate;
+  memcpy(&candidate, step, 4);
+  consider(candidate);
+
+  // Only entries stored under their own hash can be pushed as an
+  // index hit.
+  for (size_t slot = 0; slot < 64; ++slot)
+    if (qoi_ops_hash(ops->index[slot]) == slot) consider(ops->index[slot]);
+  if (best_error >= 0) return qoi_ops_push(ops, best, out);
+
+  int vg = qoi_ops_clamp(cur[1] - prev[1], -32, 31);
+  step[1] = prev[1] + vg;
+  step[0] = prev[0] + vg + qoi_ops_clamp(cur[0] - prev[0] - vg, -8, 7);
+  step[2] = prev[2] + vg + qoi_ops_clamp(cur[2] - prev[2] - vg, -8, 7);
+  memcpy(&candidate, step, 4);
+  if (qoi_ops_within(candidate, pixel, tolerance))
+    return qoi_ops_push(ops, candidate, out);
+
+  // A `QOI_OP_RGB` with the previous alpha.
+  return qoi_ops_push(ops, (pixel & 0xFFFFFF) | (px_prev & 0xFF000000), out);
+}
@@ -0,0 +1,5 @@
+compartment("qoi_encode")
+    set_default(false)
+    add_includedirs("../../include")
+    add_deps("freestanding")
+    add_files("qoi_encode.cc")
\ No newline at end of file
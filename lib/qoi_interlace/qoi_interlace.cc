@@ -0,0 +1,54 @@
+#include <qoi_interlace.h>
+
+#include "../qoi_encode/qoi_encode_ops.h"
+
+static constexpr size_t QOI_PIXELS_MAX = 400000000;
+
+static constexpr uint8_t qoi_interlace_magic[4] = {'q', 'o', 'i', 'i'};
+static constexpr uint8_t qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+ptrdiff_t qoi_interlace_encode(const qoi_desc *desc,
+                               const unsigned char *pixels, unsigned char *out,
+                               size_t out_size) {
+  if (desc->width == 0 || desc->height == 0 ||
+      desc->height >= QOI_PIXELS_MAX / desc->width ||
+      (desc->channels != 3 && desc->channels != 4) ||
+      (desc->colorspace != 0 && desc->colorspace != 4))
+    return QOI_STATUS_ERR_PARAM;
+  if (out_size < 14 + 8) return 0;
+
+  uint32_t width = __builtin_bswap32(desc->width);
+  uint32_t height = __builtin_bswap32(desc->height);
+  memcpy(out, qoi_interlace_magic, 4);
+  memcpy(out + 4, &width, 4);
+  memcpy(out + 8, &height, 4);
+  out[12] = desc->channels;
+  out[13] = desc->colorspace;
+  size_t n = 14;
+
+  // All passes are coded as one sequence of opcodes, so runs and the
+  // `index` carry over from one pass to the next.
+  qoi_ops_state ops;
+  qoi_ops_init(&ops);
+  const uint8_t channels = desc->channels;
+  for (const qoi_interlace_pass &pass : qoi_interlace_passes) {
+    for (size_t y = pass.y; y < desc->height; y += pass.dy) {
+      for (size_t x = pass.x; x < desc->width; x += pass.dx) {
+        uint32_t pixel = 0xFF000000;
+        memcpy(&pixel, pixels + (y * desc->width + x) * channels, channels);
+        // Stage the opcodes so that an image just fitting in
+        // `QOI_ENCODE_SIZE_MAX` bytes is not refused near its end.
+        unsigned char op[QOI_OPS_PIXEL_SIZE_MAX];
+        size_t op_size = qoi_ops_push(&ops, pixel, op);
+        if (out_size - n < op_size) return 0;
+        memcpy(out + n, op, op_size);
+        n += op_size;
+      }
+    }
+  }
+
+  if (out_size - n < (ops.run > 0) + sizeof(qoi_padding)) return 0;
+  n += qoi_ops_flush_run(&ops, out + n);
+  memcpy(out + n, qoi_padding, sizeof(qoi_padding));
+  return n + sizeof(qoi_padding);
+}
@@ -0,0 +1,6 @@
+#include <qoi_decode.h>
+
+const qoi_interlace_pass qoi_interlace_passes[QOI_INTERLACE_PASSES] = {
+    {0, 0, 8, 8, 8, 8}, {4, 0, 8, 8, 4, 8}, {0, 4, 4, 8, 4, 4},
+    {2, 0, 4, 4, 2, 4}, {0, 2, 2, 4, 2, 2}, {1, 0, 2, 2, 1, 2},
+    {0, 1, 1, 2, 1, 1}};
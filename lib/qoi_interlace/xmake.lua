@@ -0,0 +1,5 @@
+library("qoi_interlace")
+    set_default(false)
+    add_includedirs("../../include")
+    add_deps("freestanding")
+    add_files("qoi_interlace.cc", "qoi_interlace_passes.cc")
@@ -0,0 +1,238 @@
+#include <qoi_lz.h>
+#include <string.h>
+
+#ifndef __CHERIOT__
+#include <vector>
+#endif
+
+static constexpr uint8_t qoi_lz_magic[4] = {'q', 'o', 'i', 'z'};
+static_assert((QOI_LZ_WINDOW_SIZE & (QOI_LZ_WINDOW_SIZE - 1)) == 0);
+
+// The `QOI_LZ_PROGRESS_*` constants represent the states that the
+// decompressor can be in, within the element being read.
+static constexpr uint8_t QOI_LZ_PROGRESS_MAGIC = 0;
+static constexpr uint8_t QOI_LZ_PROGRESS_CONTROL = 1;
+static constexpr uint8_t QOI_LZ_PROGRESS_LITERAL = 2;
+static constexpr uint8_t QOI_LZ_PROGRESS_OFFSET = 3;
+static constexpr uint8_t QOI_LZ_PROGRESS_EXTRA = 4;
+static constexpr uint8_t QOI_LZ_PROGRESS_COPY = 5;
+static constexpr uint8_t QOI_LZ_PROGRESS_INVALID = 6;
+
+void qoi_lz_init(qoi_lz_decoder *lz) {
+  lz->in_buf = nullptr;
+  lz->in_buf_size = 0;
+  lz->total_in = 0;
+  lz->progress = QOI_LZ_PROGRESS_MAGIC;
+  lz->control = 0;
+  lz->offset = 0;
+  lz->length = 0;
+  lz->produced = 0;
+  lz->consumed = 0;
+}
+
+static uint8_t qoi_lz_next_byte(qoi_lz_decoder *lz) {
+  lz->in_buf_size -= 1;
+  lz->total_in += 1;
+  return *lz->in_buf++;
+}
+
+// Decompresses as much input as possible into the window, which must
+// have been fully consumed, up to its end so that the new bytes are
+// contiguous. Returns `QOI_STATUS_ERR_FORMAT` for malformed input.
+static int qoi_lz_inflate(qoi_lz_decoder *lz) {
+  constexpr size_t mask = QOI_LZ_WINDOW_SIZE - 1;
+  const size_t end = (lz->produced | mask) + 1;
+
+  while (lz->produced < end) {
+    switch (lz->progress) {
+      case QOI_LZ_PROGRESS_MAGIC:
+        // `length` counts the bytes of the magic seen so far.
+        if (lz->in_buf_size == 0) return QOI_STATUS_INPUT_EXHAUSTED;
+        if (*lz->in_buf != qoi_lz_magic[lz->length]) {
+          lz->progress = QOI_LZ_PROGRESS_INVALID;
+          return QOI_STATUS_ERR_FORMAT;
+        }
+        qoi_lz_next_byte(lz);
+        if (++lz->length == sizeof(qoi_lz_magic))
+          lz->progress = QOI_LZ_PROGRESS_CONTROL;
+        break;
+
+      case QOI_LZ_PROGRESS_CONTROL:
+        if (lz->in_buf_size == 0) return QOI_STATUS_INPUT_EXHAUSTED;
+        lz->control = qoi_lz_next_byte(lz);
+        if (lz->control & 0x80) {
+          lz->progress = QOI_LZ_PROGRESS_OFFSET;
+        } else {
+          lz->length = lz->control + 1;
+          lz->progress = QOI_LZ_PROGRESS_LITERAL;
+        }
+        break;
+
+      case QOI_LZ_PROGRESS_LITERAL: {
+        size_t count = lz->length;
+        if (count > lz->in_buf_size) count = lz->in_buf_size;
+        if (count > end - lz->produced) count = end - lz->produced;
+        if (count == 0) return QOI_STATUS_INPUT_EXHAUSTED;
+        memcpy(lz->window + (lz->produced & mask), lz->in_buf, count);
+        lz->in_buf += count;
+        lz->in_buf_size -= count;
+        lz->total_in += count;
+        lz->produced += count;
+        lz->length -= count;
+        if (lz->length == 0) lz->progress = QOI_LZ_PROGRESS_CONTROL;
+        break;
+      }
+
+      case QOI_LZ_PROGRESS_OFFSET:
+        if (lz->in_buf_size == 0) return QOI_STATUS_INPUT_EXHAUSTED;
+        // Copies may not reach back before the start of the data.
+        lz->offset = ((lz->control & 0x0F) << 8 | *lz->in_buf) + 1;
+        if (lz->offset > lz->produced) {
+          lz->progress = QOI_LZ_PROGRESS_INVALID;
+          return QOI_STATUS_ERR_FORMAT;
+        }
+        qoi_lz_next_byte(lz);
+        lz->length = ((lz->control >> 4) & 0x07) + 3;
+        lz->progress = (lz->length < 10) ? QOI_LZ_PROGRESS_COPY
+                                         : QOI_LZ_PROGRESS_EXTRA;
+        break;
+
+      case QOI_LZ_PROGRESS_EXTRA:
+        if (lz->in_buf_size == 0) return QOI_STATUS_INPUT_EXHAUSTED;
+        lz->length = 10 + qoi_lz_next_byte(lz);
+        lz->progress = QOI_LZ_PROGRESS_COPY;
+        break;
+
+      case QOI_LZ_PROGRESS_COPY: {
+        // Copy a byte at a time, as the source may overlap the bytes
+        // being written.
+        size_t count = lz->length;
+        if (count > end - lz->produced) count = end - lz->produced;
+        for (size_t i = 0; i < count; ++i, ++lz->produced)
+          lz->window[lz->produced & mask] =
+              lz->window[(lz->produced - lz->offset) & mask];
+        lz->length -= count;
+        if (lz->length == 0) lz->progress = QOI_LZ_PROGRESS_CONTROL;
+        break;
+      }
+
+      default:
+        return QOI_STATUS_ERR_PARAM;
+    }
+  }
+  return QOI_STATUS_INPUT_EXHAUSTED;
+}
+
+int qoi_lz_decode(qoi_lz_decoder *lz, qoi_stream *stream) {
+  if (stream->flags & QOI_FLAG_IN_PLACE) return QOI_STATUS_ERR_PARAM;
+
+  constexpr size_t mask = QOI_LZ_WINDOW_SIZE - 1;
+  while (true) {
+    // Pass on the decompressed bytes not yet consumed, up to the end of
+    // the window, for as long as `qoi_decode` wants more.
+    if (lz->consumed < lz->produced) {
+      const unsigned char *start = lz->window + (lz->consumed & mask);
+      size_t size = lz->produced - lz->consumed;
+      if (size > QOI_LZ_WINDOW_SIZE - (lz->consumed & mask))
+        size = QOI_LZ_WINDOW_SIZE - (lz->consumed & mask);
+      stream->in_buf = start;
+      stream->in_buf_size = size;
+      int r = qoi_decode(stream);
+      lz->consumed += stream->in_buf - start;
+      if (r != QOI_STATUS_INPUT_EXHAUSTED) return r;
+      continue;
+    }
+
+    const size_t produced = lz->produced;
+    int r = qoi_lz_inflate(lz);
+    if (r != QOI_STATUS_INPUT_EXHAUSTED) return r;
+    if (lz->produced == produced) return QOI_STATUS_INPUT_EXHAUSTED;
+  }
+}
+
+#ifndef __CHERIOT__
+// Limits of the `qoiz` elements, and how many earlier positions with
+// the same hash are tried for each match.
+static constexpr size_t QOI_LZ_LITERAL_MAX = 128;
+static constexpr size_t QOI_LZ_MATCH_MIN = 3;
+static constexpr size_t QOI_LZ_MATCH_MAX = 10 + 255;
+static constexpr size_t QOI_LZ_HASH_BITS = 12;
+static constexpr size_t QOI_LZ_CHAIN_MAX = 64;
+static constexpr size_t QOI_LZ_NONE = SIZE_MAX;
+
+static size_t qoi_lz_hash(const unsigned char *p) {
+  uint32_t v = p[0] << 16 | p[1] << 8 | p[2];
+  return (v * 2654435761u) >> (32 - QOI_LZ_HASH_BITS);
+}
+
+size_t qoi_lz_compress(const unsigned char *in, size_t in_size,
+                       unsigned char *out, size_t out_size) {
+  // A copy never takes more bytes than the literals it replaces,
+  // including any control byte it adds by splitting them.
+  if (out_size < QOI_LZ_SIZE_MAX(in_size)) return 0;
+  memcpy(out, qoi_lz_magic, sizeof(qoi_lz_magic));
+  size_t n = sizeof(qoi_lz_magic);
+
+  // Chains of earlier positions with the same hash, within the window.
+  std::vector<size_t> head(size_t(1) << QOI_LZ_HASH_BITS, QOI_LZ_NONE);
+  std::vector<size_t> prev(QOI_LZ_WINDOW_SIZE, QOI_LZ_NONE);
+  auto insert = [&](size_t i) {
+    if (in_size - i < QOI_LZ_MATCH_MIN) return;
+    size_t hash = qoi_lz_hash(in + i);
+    prev[i % QOI_LZ_WINDOW_SIZE] = head[hash];
+    head[hash] = i;
+  };
+
+  size_t literals = 0;
+  auto flush_literals = [&](size_t end) {
+    while (literals < end) {
+      size_t count = end - literals;
+      if (count > QOI_LZ_LITERAL_MAX) count = QOI_LZ_LITERAL_MAX;
+      out[n++] = count - 1;
+      memcpy(out + n, in + literals, count);
+      n += count;
+      literals += count;
+    }
+  };
+
+  size_t i = 0;
+  while (i < in_size) {
+    size_t best_length = 0;
+    size_t best_offset = 0;
+    if (in_size - i >= QOI_LZ_MATCH_MIN) {
+      size_t limit = in_size - i;
+      if (limit > QOI_LZ_MATCH_MAX) limit = QOI_LZ_MATCH_MAX;
+      size_t candidate = head[qoi_lz_hash(in + i)];
+      for (size_t depth = 0; candidate != QOI_LZ_NONE &&
+                             i - candidate <= QOI_LZ_WINDOW_SIZE &&
+                             depth < QOI_LZ_CHAIN_MAX;
+           ++depth, candidate = prev[candidate % QOI_LZ_WINDOW_SIZE]) {
+        size_t length = 0;
+        while (length < limit && in[candidate + length] == in[i + length])
+          length += 1;
+        if (length > best_length) {
+          best_length = length;
+          best_offset = i - candidate;
+          if (length == limit) break;
+        }
+      }
+    }
+
+    if (best_length < QOI_LZ_MATCH_MIN) {
+      insert(i);
+      i += 1;
+      continue;
+    }
+
+    flush_literals(i);
+    size_t code = (best_length < 10) ? best_length - 3 : 7;
+    out[n++] = 0x80 | code << 4 | (best_offset - 1) >> 8;
+    out[n++] = (best_offset - 1) & 0xFF;
+    if (code == 7) out[n++] = best_length - 10;
+    for (size_t end = i + best_length; i < end; ++i) insert(i);
+    literals = i;
+  }
+  flush_literals(in_size);
+  return n;
+}
+#endif
@@ -0,0 +1,5 @@
+library("qoi_lz")
+    set_default(false)
+    add_includedirs("../../include")
+    add_deps("freestanding")
+    add_files("qoi_lz.cc")
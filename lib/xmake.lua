@@ -1 +1,5 @@
-includes("qoi_decode")
\ No newline at end of file
+includes("qoi_decode")
+includes("qoi_anim")
+includes("qoi_encode")
+includes("qoi_interlace")
+includes("qoi_lz")
\ No newline at end of file
@@ -15,7 +15,7 @@ int main(int argc, char** argv) {
   qoi_decoder_state decoder;
   qoi_decoder_state_init(&decoder);
 
-  qoi_stream stream;
+  qoi_stream stream = {};
 
   int fd = open(argv[2], O_RDONLY);
   struct stat sb;
@@ -0,0 +1,191 @@
+#include "qoi_anim.h"
+#include "qoi_interlace.h"
+#include "test_util.h"
+
+static const size_t chunks[] = {1, 7, SIZE_MAX};
+
+// Encodes three frames of a `qoia` animation, the last two as deltas
+// and the last one carrying the state of the one before, and decodes
+// them span by span onto a canvas.
+static void test_anim() {
+  const qoi_desc desc = {24, 16, 4, 0};
+  const size_t size = size_t(desc.width) * desc.height * 4;
+  bytes frames[3];
+  frames[0] = test_image(desc.width, desc.height, 4, 27);
+  frames[1] = frames[0];
+  for (size_t y = 3; y < 9; ++y)
+    for (size_t x = 5; x < 15; ++x) frames[1][(y * desc.width + x) * 4] ^= 0x55;
+  frames[2] = frames[1];
+  memset(frames[2].data() + 100 * 4, 0x7F, 30 * 4);
+  frames[2][size - 1] ^= 1;
+
+  qoi_anim_encoder encoder = {};
+  bytes in(QOI_ANIM_HEADER_SIZE + 3 * QOI_ANIM_FRAME_SIZE_MAX(size / 4) +
+           QOI_ANIM_TAIL_SIZE);
+  size_t n = qoi_anim_encode_header(&encoder, &desc, in.data(), in.size());
+  assert(n == QOI_ANIM_HEADER_SIZE);
+  assert(qoi_anim_encode_header(&encoder, &desc, in.data(),
+                                QOI_ANIM_HEADER_SIZE - 1) == 0);
+  const uint8_t flags[3] = {0, 0, QOI_ANIM_FRAME_CARRY};
+  for (int i = 0; i < 3; ++i) {
+    size_t frame_size = qoi_anim_encode_frame(
+        &encoder, frames[i].data(), i ? frames[i - 1].data() : nullptr,
+        flags[i], in.data() + n, in.size() - n);
+    assert(frame_size > 0);
+    n += frame_size;
+  }
+  n += qoi_anim_encode_tail(in.data() + n, in.size() - n);
+  in.resize(n);
+
+  for (size_t chunk : chunks) {
+    qoi_decoder_state decoder;
+    qoi_decoder_state_init(&decoder);
+    qoi_stream stream = {};
+    stream.decoder_state = &decoder;
+
+    bytes canvas(size);
+    size_t pos = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+      size_t coded = 0;
+      int r;
+      while ((r = test_decode(&stream, in, &pos, chunk)) == QOI_STATUS_SPAN) {
+        assert(stream.frame == i);
+        stream.out_buf = canvas.data() + stream.span.offset * 4;
+        stream.out_buf_size = stream.span.length * 4;
+        coded += stream.span.length;
+      }
+      assert(r == QOI_STATUS_FRAME_DONE);
+      assert(canvas == frames[i]);
+      // Delta frames only code the pixels around the changes.
+      assert(i == 0 ? coded == size / 4 : coded < size / 8);
+    }
+    assert(test_decode(&stream, in, &pos, chunk) == QOI_STATUS_DONE);
+    assert(pos == in.size());
+  }
+
+  // Descriptions that the decoder would refuse.
+  const qoi_desc invalid[] = {
+      {0, 16, 4, 0},  {24, 0, 4, 0},  {20000, 20000, 4, 0},
+      {24, 16, 2, 0}, {24, 16, 4, 1},
+  };
+  for (const qoi_desc& bad : invalid)
+    assert(qoi_anim_encode_header(&encoder, &bad, in.data(), in.size()) ==
+           QOI_STATUS_ERR_PARAM);
+}
+
+// A `QOI_OP_RUN` that continues past the end of its span is invalid.
+static void test_anim_run_across_span() {
+  const unsigned char in[] = {
+      'q', 'o', 'i', 'a', 0, 0, 0, 4, 0, 0, 0, 1, 4, 0,
+      // A delta frame with a span of two pixels at the start, coded
+      // as a run of three.
+      QOI_ANIM_FRAME | QOI_ANIM_FRAME_DELTA, 0, 2, 0b11000010,
+      // Another span, and the tail.
+      0, 2, 0b11000001, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = {};
+  stream.decoder_state = &decoder;
+  stream.in_buf = in;
+  stream.in_buf_size = sizeof(in);
+  unsigned char out[16];
+  stream.out_buf = out;
+  stream.out_buf_size = sizeof(out);
+  assert(qoi_decode(&stream) == QOI_STATUS_SPAN);
+  assert(stream.span.offset == 0 && stream.span.length == 2);
+  assert(qoi_decode(&stream) == QOI_STATUS_ERR_FORMAT);
+}
+
+// Encodes `qoii` interlaced images, and decodes them whole and with
+// previews of each pass, which fill the block that each pixel stands
+// for.
+static void test_interlace() {
+  const uint32_t sizes[][2] = {{29, 19}, {3, 2}, {1, 9}};
+  for (auto size : sizes) {
+    const uint32_t width = size[0], height = size[1];
+    const qoi_desc desc = {width, height, 4, 0};
+    const bytes pixels = test_image(width, height, 4, 48);
+    bytes in(QOI_ENCODE_SIZE_MAX(&desc));
+    const ptrdiff_t n =
+        qoi_interlace_encode(&desc, pixels.data(), in.data(), in.size());
+    assert(n > 0 && qoi_interlace_encode(&desc, pixels.data(), in.data(),
+                                         n - 1) == 0);
+    in.resize(n);
+    assert(memcmp(in.data(), "qoii", 4) == 0);
+
+    for (size_t chunk : chunks) {
+      qoi_decoder_state decoder;
+      qoi_decoder_state_init(&decoder);
+      qoi_stream stream = {};
+      stream.decoder_state = &decoder;
+      bytes out(pixels.size());
+      assert(test_decode_all(&stream, in, &out, chunk) == QOI_STATUS_DONE);
+      assert(out == pixels);
+
+      // After the first pass, each pixel shows the top left pixel of
+      // its 8 by 8 block.
+      qoi_decoder_state_init(&decoder);
+      stream = {};
+      stream.flags = QOI_FLAG_PREVIEW;
+      stream.decoder_state = &decoder;
+      out.assign(out.size(), 0);
+      stream.out_buf = out.data();
+      stream.out_buf_size = out.size();
+      size_t pos = 0;
+      int passes = 0;
+      int r;
+      while ((r = test_decode(&stream, in, &pos, chunk)) ==
+             QOI_STATUS_PASS_DONE) {
+        if (passes++ > 0) continue;
+        for (size_t i = 0; i < size_t(width) * height; ++i) {
+          const size_t x = i % width & ~size_t(7), y = i / width & ~size_t(7);
+          assert(test_pixel(out, i, 4) ==
+                 test_pixel(pixels, y * width + x, 4));
+        }
+      }
+      assert(r == QOI_STATUS_DONE);
+      assert(out == pixels);
+      // Every pass but the last is reported in an image large enough
+      // for all of them to have pixels.
+      if (width >= 8 && height >= 8) assert(passes == 6);
+    }
+  }
+
+  // An output buffer smaller than the image is refused rather than
+  // asking for more output, which could never arrive.
+  const qoi_desc desc = {29, 19, 4, 0};
+  const bytes pixels = test_image(29, 19, 4, 48);
+  bytes in(QOI_ENCODE_SIZE_MAX(&desc));
+  in.resize(qoi_interlace_encode(&desc, pixels.data(), in.data(), in.size()));
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = {};
+  stream.decoder_state = &decoder;
+  bytes out(pixels.size());
+  stream.in_buf = in.data();
+  stream.in_buf_size = in.size();
+  stream.out_buf = out.data();
+  stream.out_buf_size = out.size() - 4;
+  assert(qoi_decode(&stream) == QOI_STATUS_ERR_PARAM);
+  // Decoding can then continue with the whole buffer.
+  stream.out_buf_size = out.size();
+  assert(qoi_decode(&stream) == QOI_STATUS_DONE);
+  assert(out == pixels);
+
+  // Descriptions that `qoi_encode` would refuse.
+  const qoi_desc invalid[] = {
+      {0, 19, 4, 0},  {29, 0, 4, 0},  {20000, 20000, 4, 0},
+      {29, 19, 5, 0}, {29, 19, 4, 1},
+  };
+  for (const qoi_desc& bad : invalid)
+    assert(qoi_interlace_encode(&bad, pixels.data(), in.data(), in.size()) ==
+           QOI_STATUS_ERR_PARAM);
+}
+
+int main() {
+  test_anim();
+  test_anim_run_across_span();
+  test_interlace();
+  return 0;
+}
@@ -0,0 +1,238 @@
+#include "test_util.h"
+
+// Chunk sizes in which input is fed to the decoder: one byte at a time,
+// an odd size that splits opcodes in many places, and all at once.
+static const size_t chunks[] = {1, 7, SIZE_MAX};
+
+// Decodes three concatenated images of different sizes and channels with
+// `QOI_FLAG_MULTI_FRAME`.
+static void test_multi_frame() {
+  const qoi_desc descs[3] = {{17, 5, 4, 0}, {1, 1, 3, 0}, {40, 23, 3, 4}};
+  bytes images[3];
+  bytes in;
+  for (int i = 0; i < 3; ++i) {
+    images[i] = test_image(descs[i].width, descs[i].height, descs[i].channels,
+                           i);
+    bytes qoi = test_encode(descs[i], images[i]);
+    in.insert(in.end(), qoi.begin(), qoi.end());
+  }
+
+  for (size_t chunk : chunks) {
+    qoi_decoder_state decoder;
+    qoi_decoder_state_init(&decoder);
+    qoi_stream stream = {};
+    stream.flags = QOI_FLAG_MULTI_FRAME;
+    stream.decoder_state = &decoder;
+
+    size_t pos = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+      bytes out(images[i].size());
+      stream.out_buf = out.data();
+      stream.out_buf_size = out.size();
+      assert(test_decode(&stream, in, &pos, chunk) == QOI_STATUS_FRAME_DONE);
+      assert(stream.frame == i);
+      assert(stream.desc.width == descs[i].width);
+      assert(stream.desc.height == descs[i].height);
+      assert(stream.desc.channels == descs[i].channels);
+      assert(stream.desc.colorspace == descs[i].colorspace);
+      assert(stream.out_buf_size == 0);
+      assert(out == images[i]);
+    }
+
+    // The whole input is consumed, and the decoder waits for the header
+    // of another image.
+    assert(pos == in.size());
+    assert(stream.total_in == in.size());
+    assert(test_decode(&stream, in, &pos, chunk) ==
+           QOI_STATUS_INPUT_EXHAUSTED);
+  }
+}
+
+// Validates `in` with `QOI_FLAG_VALIDATE`, feeding it `chunk` bytes at a
+// time, and returns the final status.
+static int validate(const bytes& in, size_t chunk, qoi_stream* stream) {
+  static qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  *stream = {};
+  stream->flags = QOI_FLAG_VALIDATE;
+  stream->decoder_state = &decoder;
+  size_t pos = 0;
+  return test_decode(stream, in, &pos, chunk);
+}
+
+// Checks valid, truncated and corrupt images with `QOI_FLAG_VALIDATE`.
+static void test_validate() {
+  const qoi_desc desc = {31, 9, 4, 0};
+  const bytes in = test_encode(desc, test_image(31, 9, 4, 28));
+  qoi_stream stream;
+
+  for (size_t chunk : chunks) {
+    assert(validate(in, chunk, &stream) == QOI_STATUS_DONE);
+    assert(stream.total_in == in.size());
+    assert(stream.total_pixels == 31 * 9);
+    // Further calls have no effect.
+    assert(qoi_decode(&stream) == QOI_STATUS_DONE);
+  }
+
+  // Decoding also consumes the whole tail and then stays done.
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  stream = {};
+  stream.decoder_state = &decoder;
+  bytes out(31 * 9 * 4);
+  assert(test_decode_all(&stream, in, &out, SIZE_MAX) == QOI_STATUS_DONE);
+  assert(stream.in_buf_size == 0);
+  assert(stream.total_in == in.size());
+  assert(qoi_decode(&stream) == QOI_STATUS_DONE);
+
+  // Every truncated image asks for more input, having consumed all of
+  // it.
+  for (size_t size = 1; size < in.size(); ++size) {
+    bytes truncated(in.begin(), in.begin() + size);
+    assert(validate(truncated, 5, &stream) == QOI_STATUS_INPUT_EXHAUSTED);
+    assert(stream.total_in == size);
+  }
+
+  // Corruption of the header or tail is found, and located.
+  struct {
+    size_t offset;
+    size_t length;
+    unsigned char value;
+    size_t error_offset;
+  } corruptions[] = {
+      {0, 1, 'Q', 0},    // Magic.
+      {4, 4, 0, 8},      // Zero width, found with the height.
+      {8, 4, 0, 8},      // Zero height.
+      {12, 1, 2, 12},    // Channels.
+      {13, 1, 3, 13},    // Colorspace.
+      {in.size() - 8, 1, 0x20, in.size() - 8},
+      {in.size() - 1, 1, 2, in.size() - 1},
+  };
+  for (auto corruption : corruptions) {
+    bytes corrupt = in;
+    memset(corrupt.data() + corruption.offset, corruption.value,
+           corruption.length);
+    for (size_t chunk : chunks) {
+      assert(validate(corrupt, chunk, &stream) == QOI_STATUS_ERR_FORMAT);
+      assert(stream.error_offset == corruption.error_offset);
+    }
+  }
+
+  // Opcodes that code more pixels than the image has are cut short, so
+  // the bytes after them are read as the tail.
+  bytes extra = in;
+  extra.insert(extra.end() - 8, {0b11000000, 0b11000000});
+  assert(validate(extra, SIZE_MAX, &stream) == QOI_STATUS_ERR_FORMAT);
+  assert(stream.error_offset == in.size() - 8);
+}
+
+// Bitwise CRC32C, for reference.
+static uint32_t crc32c(const bytes& data) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (unsigned char byte : data) {
+    crc ^= byte;
+    for (int bit = 0; bit < 8; ++bit)
+      crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+  }
+  return ~crc;
+}
+
+// Decodes `in` with `QOI_FLAG_CHECKSUM` and returns the checksum.
+static uint32_t checksum(const bytes& in, size_t out_size, size_t chunk) {
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = {};
+  stream.flags = QOI_FLAG_CHECKSUM;
+  stream.decoder_state = &decoder;
+  bytes out(out_size);
+  assert(test_decode_all(&stream, in, &out, chunk) == QOI_STATUS_DONE);
+  assert(stream.checksum == crc32c(out));
+  return stream.checksum;
+}
+
+// Checks `QOI_FLAG_CHECKSUM` against known values and corrupt pixels.
+static void test_checksum() {
+  // The CRC32C check value, from the pixels "123", "456" and "789".
+  const qoi_desc check_desc = {3, 1, 3, 0};
+  const unsigned char digits[] = "123456789";
+  const bytes check = test_encode(check_desc, bytes(digits, digits + 9));
+  assert(checksum(check, 9, 1) == 0xE3069283);
+
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {45, 20, channels, 0};
+    const bytes pixels = test_image(45, 20, channels, 29);
+    const bytes in = test_encode(desc, pixels);
+    for (size_t chunk : chunks)
+      assert(checksum(in, pixels.size(), chunk) == crc32c(pixels));
+
+    // A flipped bit in the colour of a `QOI_OP_RGB` still decodes, but
+    // the checksum no longer matches.
+    bytes corrupt = in;
+    size_t offset = 14;
+    for (uint8_t op; (op = in[offset]) != 0b11111110;)
+      offset += (op == 0b11111111) ? 5 : (op >> 6 == 0b10) ? 2 : 1;
+    corrupt[offset + 2] ^= 0x10;
+    assert(checksum(corrupt, pixels.size(), SIZE_MAX) != crc32c(pixels));
+  }
+}
+
+// Decodes `in` in place, in a buffer `margin` bytes larger than the
+// decoded image, with `QOI_FLAG_IN_PLACE`. Returns the final status,
+// with the decoded pixels in `out` on success.
+static int decode_in_place(const bytes& in, const qoi_desc& desc,
+                           size_t margin, bytes* out) {
+  const size_t size = size_t(desc.width) * desc.height * desc.channels;
+  bytes buf(size + margin);
+  assert(buf.size() >= in.size());
+  memcpy(buf.data() + buf.size() - in.size(), in.data(), in.size());
+
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = {};
+  stream.flags = QOI_FLAG_IN_PLACE;
+  stream.decoder_state = &decoder;
+  stream.in_buf = buf.data() + buf.size() - in.size();
+  stream.in_buf_size = in.size();
+  stream.out_buf = buf.data();
+  stream.out_buf_size = size;
+  int r = qoi_decode(&stream);
+  out->assign(buf.begin(), buf.begin() + size);
+  return r;
+}
+
+// Checks `qoi_inplace_margin` on generated images, and that it is exact
+// for the worst case: a run followed by `QOI_OP_RGBA` literals, each of
+// which uses one more byte of input than it produces.
+static void test_in_place() {
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {50, 30, channels, 0};
+    const bytes pixels = test_image(50, 30, channels, 30);
+    const bytes in = test_encode(desc, pixels);
+    bytes out;
+    assert(decode_in_place(in, desc, qoi_inplace_margin(&desc, in.size()),
+                           &out) == QOI_STATUS_DONE);
+    assert(out == pixels);
+  }
+
+  const qoi_desc desc = {100, 2, 4, 0};
+  bytes pixels(100 * 2 * 4);
+  for (size_t i = 0; i < 200; ++i) {
+    const uint32_t pixel = (i < 150) ? 0xFF000000 : 0x01020304 * uint32_t(i);
+    memcpy(pixels.data() + i * 4, &pixel, 4);
+  }
+  const bytes in = test_encode(desc, pixels);
+  const size_t margin = qoi_inplace_margin(&desc, in.size());
+  bytes out;
+  assert(decode_in_place(in, desc, margin, &out) == QOI_STATUS_DONE);
+  assert(out == pixels);
+  assert(decode_in_place(in, desc, margin - 1, &out) ==
+         QOI_STATUS_ERR_OVERLAP);
+}
+
+int main() {
+  test_multi_frame();
+  test_validate();
+  test_checksum();
+  test_in_place();
+  return 0;
+}
@@ -0,0 +1,127 @@
+#define STBI_ONLY_PNG 1
+#define STB_IMAGE_IMPLEMENTATION
+#include <fcntl.h>
+#include <stb_image.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "qoi_encode.h"
+#include "qoi_encode_host.h"
+
+// Encodes the PNG in argv[1] one byte of input and output at a time,
+// and all at once with `qoi_encode_host` and its parallel variant, and
+// checks the results against the reference encoding in argv[2]. The
+// last band of the parallel encoding is also decoded from its
+// checkpoint.
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s image.png reference.qoi\n", argv[0]);
+    return 2;
+  }
+
+  qoi_encoder_state encoder;
+  qoi_encoder_state_init(&encoder);
+
+  int fd = open(argv[2], O_RDONLY);
+  struct stat sb;
+  fstat(fd, &sb);
+  unsigned char* expected =
+      (unsigned char*)mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  int x, y, n;
+  unsigned char* data = stbi_load(argv[1], &x, &y, &n, expected[12]);
+  size_t in_size = (size_t)x * y * expected[12];
+  unsigned char* out_buf = (unsigned char*)calloc(sb.st_size, 1);
+
+  qoi_encode_stream stream = {};
+  stream.desc.width = x;
+  stream.desc.height = y;
+  stream.desc.channels = expected[12];
+  stream.desc.colorspace = expected[13];
+  stream.encoder_state = &encoder;
+
+  size_t in_idx = 0;
+  size_t out_idx = 0;
+
+  int r;
+  do {
+    stream.in_buf = data + in_idx;
+    stream.in_buf_size = in_idx < in_size ? 1 : 0;
+    stream.out_buf = out_buf + out_idx;
+    stream.out_buf_size = out_idx < (size_t)sb.st_size ? 1 : 0;
+    r = qoi_encode(&stream);
+    assert(r >= 0);
+    in_idx = stream.total_in;
+    out_idx = stream.total_out;
+  } while (r != QOI_STATUS_DONE);
+
+  assert(in_idx == in_size);
+  assert(out_idx == (size_t)sb.st_size);
+  assert(memcmp(out_buf, expected, sb.st_size) == 0);
+
+  size_t host_size = QOI_ENCODE_SIZE_MAX(&stream.desc);
+  unsigned char* host_buf = (unsigned char*)malloc(host_size);
+  assert(qoi_encode_host(&stream.desc, data, host_buf, host_size) ==
+         (size_t)sb.st_size);
+  assert(memcmp(host_buf, expected, sb.st_size) == 0);
+
+  memset(host_buf, 0, host_size);
+  uint32_t bands = y < 7 ? y : 7;
+  qoi_checkpoint checkpoints[7];
+  assert(qoi_encode_host_parallel(&stream.desc, data, host_buf, host_size,
+                                  bands, 3, checkpoints) == (size_t)sb.st_size);
+  assert(memcmp(host_buf, expected, sb.st_size) == 0);
+
+  // Decode the last band from its checkpoint.
+  qoi_decoder_state decoder;
+  qoi_stream decode = {};
+  decode.desc = stream.desc;
+  decode.decoder_state = &decoder;
+  const qoi_checkpoint* last = &checkpoints[bands - 1];
+  assert(qoi_decode_resume(&decode, last) == QOI_STATUS_DONE);
+  size_t band_size = in_size - last->pixel * stream.desc.channels;
+  unsigned char* band = (unsigned char*)malloc(band_size);
+  decode.in_buf = expected + last->offset;
+  decode.in_buf_size = sb.st_size - last->offset;
+  decode.out_buf = band;
+  decode.out_buf_size = band_size;
+  assert(qoi_decode(&decode) == QOI_STATUS_DONE);
+  assert(memcmp(band, data + last->pixel * stream.desc.channels,
+                band_size) == 0);
+
+  // Encode a BGR565 version of 3-channel images, checking it against
+  // the host encoding of the same pixels expanded to RGB888.
+  if (stream.desc.channels == 3) {
+    size_t count = (size_t)x * y;
+    uint16_t* bgr565 = (uint16_t*)malloc(count * 2);
+    for (size_t i = 0; i < count; ++i) {
+      const unsigned char* p = data + i * 3;
+      uint16_t v = (p[2] & 0xF8) << 8 | (p[1] & 0xFC) << 3 | p[0] >> 3;
+      bgr565[i] = __builtin_bswap16(v);
+      unsigned char* q = data + i * 3;
+      q[0] = (p[0] & 0xF8) | p[0] >> 5;
+      q[1] = (p[1] & 0xFC) | p[1] >> 6;
+      q[2] = (p[2] & 0xF8) | p[2] >> 5;
+    }
+    size_t host_n = qoi_encode_host(&stream.desc, data, host_buf, host_size);
+    assert(host_n > 0);
+
+    qoi_encoder_state_init(&encoder);
+    stream.in_buf = (const unsigned char*)bgr565;
+    stream.in_buf_size = count * 2;
+    stream.out_buf = out_buf = (unsigned char*)realloc(out_buf, host_size);
+    stream.out_buf_size = host_size;
+    stream.format = QOI_FORMAT_BGR565;
+    assert(qoi_encode(&stream) == QOI_STATUS_DONE);
+    assert(stream.total_out == host_n);
+    assert(memcmp(out_buf, host_buf, host_n) == 0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "qoi_encode.h"
+#include "test_util.h"
+
+// Encodes `in` with the options in `settings`, feeding it `chunk` bytes
+// at a time with unlimited output space, and returns the output.
+static bytes encode(const bytes& in, const qoi_encode_stream& settings,
+                    size_t chunk) {
+  qoi_encoder_state encoder;
+  qoi_encoder_state_init(&encoder);
+  qoi_encode_stream stream = settings;
+  stream.encoder_state = &encoder;
+  bytes out(QOI_ENCODE_SIZE_MAX(&settings.desc) + 256);
+  stream.out_buf = out.data();
+  stream.out_buf_size = out.size();
+  size_t pos = 0;
+  int r;
+  do {
+    size_t size = std::min(in.size() - pos, chunk);
+    stream.in_buf = in.data() + pos;
+    stream.in_buf_size = size;
+    r = qoi_encode(&stream);
+    assert(r >= 0);
+    pos = stream.in_buf - in.data();
+    assert(r != QOI_STATUS_INPUT_EXHAUSTED || size > 0);
+  } while (r != QOI_STATUS_DONE);
+  assert(pos == in.size());
+  out.resize(stream.total_out);
+  return out;
+}
+
+// Encodes generated images one byte of input and output at a time, and
+// checks the result against the reference encoder.
+static void test_reference() {
+  const uint32_t sizes[][2] = {{1, 1}, {7, 3}, {50, 30}, {129, 17}};
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    for (auto size : sizes) {
+      for (uint8_t colorspace : {0, 4}) {
+        const qoi_desc desc = {size[0], size[1], channels, colorspace};
+        const bytes pixels =
+            test_image(size[0], size[1], channels, size[0] + channels);
+        const bytes expected = test_encode(desc, pixels);
+
+        qoi_encoder_state encoder;
+        qoi_encoder_state_init(&encoder);
+        qoi_encode_stream stream = {};
+        stream.desc = desc;
+        stream.encoder_state = &encoder;
+        bytes out(expected.size());
+        int r;
+        do {
+          stream.in_buf = pixels.data() + stream.total_in;
+          stream.in_buf_size = stream.total_in < pixels.size() ? 1 : 0;
+          stream.out_buf = out.data() + stream.total_out;
+          stream.out_buf_size = stream.total_out < out.size() ? 1 : 0;
+          r = qoi_encode(&stream);
+          assert(r == QOI_STATUS_INPUT_EXHAUSTED ||
+                 r == QOI_STATUS_OUTPUT_EXHAUSTED || r == QOI_STATUS_DONE);
+        } while (r != QOI_STATUS_DONE);
+        assert(stream.total_in == pixels.size());
+        assert(stream.total_out == expected.size());
+        assert(out == expected);
+      }
+    }
+  }
+}
+
+// Encodes 16-bit input in both byte orders, fed in chunks that split
+// pixels and runs, and checks the result against the reference encoding
+// of the expanded pixels and a 16-bit decode of it.
+static void test_565() {
+  const uint32_t width = 13, height = 7;
+  const size_t count = width * height;
+
+  // Runs, one of them across rows, between changes of each field.
+  bytes in(count * 2);
+  uint32_t state = 44;
+  uint16_t value = 0;
+  for (size_t i = 0; i < count; ++i) {
+    state = state * 1664525u + 1013904223u;
+    const uint32_t mode = state >> 28;
+    if (i >= 10 && i < 30) {
+      // Part of the run across rows.
+    } else if (mode < 6) {
+      value = state >> 8;
+    } else if (mode < 10) {
+      value ^= 1 << (state >> 8) % 16;
+    }
+    in[i * 2] = value;
+    in[i * 2 + 1] = value >> 8;
+  }
+
+  for (uint8_t format : {QOI_FORMAT_RGB565, QOI_FORMAT_BGR565}) {
+    bytes pixels(count * 3);
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t v = in[i * 2] | in[i * 2 + 1] << 8;
+      if (format == QOI_FORMAT_BGR565) v = (v & 0xFF) << 8 | v >> 8;
+      uint32_t c[3] = {v >> 11, (v >> 5) & 0x3F, v & 0x1F};
+      if (format == QOI_FORMAT_BGR565) std::swap(c[0], c[2]);
+      pixels[i * 3] = c[0] << 3 | c[0] >> 2;
+      pixels[i * 3 + 1] = c[1] << 2 | c[1] >> 4;
+      pixels[i * 3 + 2] = c[2] << 3 | c[2] >> 2;
+    }
+
+    qoi_encode_stream settings = {};
+    settings.desc = {width, height, 3, 0};
+    settings.format = format;
+    const bytes expected = test_encode(settings.desc, pixels);
+    for (size_t chunk : {size_t(1), size_t(3), size_t(7), SIZE_MAX})
+      assert(encode(in, settings, chunk) == expected);
+
+    qoi_decoder_state decoder;
+    qoi_decoder_state_init(&decoder);
+    qoi_stream stream = {};
+    stream.format = format;
+    stream.decoder_state = &decoder;
+    bytes out(count * 2);
+    assert(test_decode_all(&stream, expected, &out, SIZE_MAX) ==
+           QOI_STATUS_DONE);
+    assert(out == in);
+
+    // 16-bit input only describes 3-channel images.
+    qoi_encoder_state encoder;
+    qoi_encoder_state_init(&encoder);
+    qoi_encode_stream stream4 = settings;
+    stream4.desc.channels = 4;
+    stream4.encoder_state = &encoder;
+    bytes out4(QOI_ENCODE_SIZE_MAX(&stream4.desc));
+    stream4.in_buf = in.data();
+    stream4.in_buf_size = in.size();
+    stream4.out_buf = out4.data();
+    stream4.out_buf_size = out4.size();
+    assert(qoi_encode(&stream4) == QOI_STATUS_ERR_PARAM);
+  }
+}
+
+// Encodes rows separated by padding, fed in chunks that split the
+// padding in every way, and without the padding after the last row.
+static void test_stride() {
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {13, 7, channels, 0};
+    const bytes pixels = test_image(13, 7, channels, 45);
+    const bytes expected = test_encode(desc, pixels);
+    const size_t row = 13 * channels, stride = row + 5;
+
+    bytes in(stride * 6 + row, 0xEE);
+    for (size_t y = 0; y < 7; ++y)
+      memcpy(in.data() + y * stride, pixels.data() + y * row, row);
+
+    qoi_encode_stream settings = {};
+    settings.desc = desc;
+    settings.in_stride = stride;
+    for (size_t chunk : {size_t(1), size_t(3), size_t(7), row, row + 1,
+                         row + 4, stride, stride + 2, SIZE_MAX})
+      assert(encode(in, settings, chunk) == expected);
+  }
+}
+
+// Decodes a QOI file with the description `desc`, and optionally a
+// preset dictionary.
+static bytes decode(const bytes& in, const qoi_desc& desc,
+                    const qoi_dictionary* dictionary = nullptr) {
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = {};
+  stream.dictionary = dictionary;
+  stream.decoder_state = &decoder;
+  bytes out(size_t(desc.width) * desc.height * desc.channels);
+  assert(test_decode_all(&stream, in, &out, SIZE_MAX) == QOI_STATUS_DONE);
+  return out;
+}
+
+// Encodes with `tolerance`, decodes the result, and checks that each
+// channel of each pixel is within its tolerance of the source, and that
+// the output is no larger than the lossless one.
+static void test_near_lossless() {
+  const uint8_t tolerances[][4] = {
+      {1, 1, 1, 0}, {2, 2, 2, 2}, {4, 1, 8, 3}, {0, 0, 6, 0}, {16, 16, 16, 0}};
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {41, 23, channels, 0};
+    const bytes pixels = test_image(41, 23, channels, 46);
+    const bytes lossless = test_encode(desc, pixels);
+
+    for (auto tolerance : tolerances) {
+      qoi_encode_stream settings = {};
+      settings.desc = desc;
+      memcpy(settings.tolerance, tolerance, 4);
+      const bytes in = encode(pixels, settings, SIZE_MAX);
+      assert(encode(pixels, settings, 3) == in);
+      assert(in.size() < lossless.size());
+
+      const bytes out = decode(in, desc);
+      for (size_t i = 0; i < out.size(); ++i) {
+        const int error = int(out[i]) - int(pixels[i]);
+        assert(std::abs(error) <= tolerance[i % channels]);
+      }
+    }
+  }
+}
+
+// Encodes an image drawn from a small palette with and without a
+// dictionary made from it, which makes the first use of each colour a
+// `QOI_OP_INDEX` instead of a `QOI_OP_RGB` or `QOI_OP_RGBA`.
+static void test_dictionary() {
+  uint32_t palette[12];
+  for (uint32_t i = 0; i < 12; ++i) palette[i] = 0xFF000000 | i * 0x153B77;
+  palette[11] = 0x80FFFFFF;
+  qoi_dictionary dictionary;
+  qoi_dictionary_init(&dictionary, palette, 12);
+  for (uint32_t color : palette)
+    assert(dictionary.index[qoi_pixel_hash(color) % 64] == color);
+
+  const qoi_desc desc = {12, 3, 4, 0};
+  bytes pixels(12 * 3 * 4);
+  for (size_t i = 0; i < 12 * 3; ++i)
+    memcpy(pixels.data() + i * 4, &palette[i * 5 % 12], 4);
+
+  qoi_encode_stream settings = {};
+  settings.desc = desc;
+  const bytes plain = encode(pixels, settings, SIZE_MAX);
+  settings.dictionary = &dictionary;
+  const bytes preset = encode(pixels, settings, SIZE_MAX);
+  assert(encode(pixels, settings, 5) == preset);
+  // The first use of each colour makes up much of such a small image.
+  assert(preset.size() * 3 < plain.size() * 2);
+  assert(decode(plain, desc) == pixels);
+  assert(decode(preset, desc, &dictionary) == pixels);
+  assert(decode(preset, desc) != pixels);
+
+  // A 3-channel `qoix` image of distinct pixels, none of them in the
+  // palette, that are all too far apart for anything but `QOI_OP_RGB`.
+  // After a dictionary whose previous pixel is not opaque, it fills
+  // `QOI_ENCODE_SIZE_MAX` exactly.
+  dictionary.px_prev = 0x80123456;
+  const qoi_desc rgb_desc = {16, 8, 3, 0};
+  bytes rgb(16 * 8 * 3);
+  for (size_t i = 0; i < 16 * 8; ++i) {
+    rgb[i * 3] = i;
+    rgb[i * 3 + 1] = i * 100;
+    rgb[i * 3 + 2] = 0x40;
+  }
+  qoi_encoder_state encoder;
+  qoi_encoder_state_init(&encoder);
+  qoi_extended_state extended;
+  qoi_encode_stream stream = {};
+  stream.desc = rgb_desc;
+  stream.dictionary = &dictionary;
+  stream.profile = QOI_PROFILE_EXTENDED;
+  stream.encoder_state = &encoder;
+  stream.extended_state = &extended;
+  bytes out(QOI_ENCODE_SIZE_MAX(&rgb_desc));
+  stream.in_buf = rgb.data();
+  stream.in_buf_size = rgb.size();
+  stream.out_buf = out.data();
+  stream.out_buf_size = out.size();
+  assert(qoi_encode(&stream) == QOI_STATUS_DONE);
+  assert(stream.total_out == out.size());
+
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream decode_stream = {};
+  decode_stream.dictionary = &dictionary;
+  decode_stream.decoder_state = &decoder;
+  decode_stream.extended_state = &extended;
+  bytes decoded(rgb.size());
+  assert(test_decode_all(&decode_stream, out, &decoded, SIZE_MAX) ==
+         QOI_STATUS_DONE);
+  assert(decoded == rgb);
+}
+
+// Decodes a `qoix` image with `flags`, passing the input in two
+// buffers split at `split`, and writing runs reported with
+// `QOI_FLAG_RUNS` into `out` by hand. Returns the decoder's stream.
+static qoi_stream decode_extended(const bytes& in, uint32_t flags,
+                                  size_t split, bytes* out) {
+  static qoi_decoder_state decoder;
+  static qoi_extended_state extended;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = {};
+  stream.flags = flags;
+  stream.decoder_state = &decoder;
+  stream.extended_state = &extended;
+  stream.in_buf = in.data();
+  stream.in_buf_size = split;
+  stream.out_buf = out->data();
+  stream.out_buf_size = out->size();
+  int r;
+  while ((r = qoi_decode(&stream)) != QOI_STATUS_DONE) {
+    if (r == QOI_STATUS_INPUT_EXHAUSTED) {
+      assert(stream.in_buf == in.data() + split);
+      stream.in_buf_size = in.size() - split;
+      continue;
+    }
+    assert(r == QOI_STATUS_RUN);
+    const size_t end = stream.span.offset + stream.span.length;
+    for (size_t i = stream.span.offset; i < end; ++i)
+      memcpy(out->data() + i * 4, &stream.run_color, 4);
+    stream.out_buf = out->data() + end * 4;
+    stream.out_buf_size = out->size() - end * 4;
+  }
+  assert(stream.in_buf == in.data() + in.size());
+  return stream;
+}
+
+// Encodes a `qoix` image with long runs, and decodes it with and
+// without `QOI_FLAG_VALIDATE` and `QOI_FLAG_RUNS`, with the input split
+// everywhere around the count of a `QOI_OP_RUN_LONG`.
+static void test_extended() {
+  const qoi_desc desc = {40, 30, 4, 0};
+  const size_t count = 40 * 30;
+  bytes pixels = test_image(40, 30, 4, 49);
+  // Runs of 300 pixels, a `QOI_OP_RUN_LONG`, and of 61, which is
+  // larger than in `qoif`.
+  const uint32_t colors[2] = {0xFF3060C0, 0xFFC06030};
+  for (size_t i = 200; i < 500; ++i) memcpy(pixels.data() + i * 4, colors, 4);
+  for (size_t i = 700; i < 761; ++i)
+    memcpy(pixels.data() + i * 4, colors + 1, 4);
+
+  qoi_extended_state extended;
+  qoi_encode_stream settings = {};
+  settings.desc = desc;
+  settings.profile = QOI_PROFILE_EXTENDED;
+  settings.extended_state = &extended;
+  const bytes in = encode(pixels, settings, SIZE_MAX);
+  assert(memcmp(in.data(), "qoix", 4) == 0);
+  assert(in[14] == QOI_PROFILE_VERSION);
+  for (size_t chunk : {size_t(1), size_t(7)})
+    assert(encode(pixels, settings, chunk) == in);
+
+  // The profile needs the extended state.
+  qoi_encoder_state encoder;
+  qoi_encoder_state_init(&encoder);
+  bytes out(in.size());
+  qoi_encode_stream stream = settings;
+  stream.extended_state = nullptr;
+  stream.encoder_state = &encoder;
+  stream.in_buf = pixels.data();
+  stream.in_buf_size = pixels.size();
+  stream.out_buf = out.data();
+  stream.out_buf_size = out.size();
+  assert(qoi_encode(&stream) == QOI_STATUS_ERR_PARAM);
+
+  // Find the `QOI_OP_RUN_LONG`.
+  size_t offset = 15;
+  for (uint8_t op; (op = in[offset]) != QOI_OP_RUN_LONG;)
+    offset += (op == 0b11111111)         ? 5
+              : (op == 0b11111110)       ? 4
+              : (op == QOI_OP_INDEX_BIG) ? 2
+              : (op >> 6 == 0b10)        ? 2
+                                         : 1;
+  assert((in[offset + 1] << 8 | in[offset + 2]) == 299 - QOI_RUN_LONG_MIN);
+
+  for (size_t split = offset; split <= offset + 3; ++split) {
+    out.assign(count * 4, 0);
+    decode_extended(in, 0, split, &out);
+    assert(out == pixels);
+
+    qoi_stream validated = decode_extended(in, QOI_FLAG_VALIDATE, split, &out);
+    assert(validated.total_pixels == count);
+
+    out.assign(count * 4, 0);
+    decode_extended(in, QOI_FLAG_RUNS, split, &out);
+    assert(out == pixels);
+  }
+
+  // The decoder asks for the extended state once it sees the header,
+  // and then carries on.
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream decode_stream = {};
+  decode_stream.decoder_state = &decoder;
+  out.assign(count * 4, 0);
+  decode_stream.in_buf = in.data();
+  decode_stream.in_buf_size = in.size();
+  decode_stream.out_buf = out.data();
+  decode_stream.out_buf_size = out.size();
+  assert(qoi_decode(&decode_stream) == QOI_STATUS_ERR_PARAM);
+  decode_stream.extended_state = &extended;
+  assert(qoi_decode(&decode_stream) == QOI_STATUS_DONE);
+  assert(out == pixels);
+
+  // Validation does without it.
+  qoi_decoder_state_init(&decoder);
+  qoi_stream validate_stream = {};
+  validate_stream.flags = QOI_FLAG_VALIDATE;
+  validate_stream.decoder_state = &decoder;
+  validate_stream.in_buf = in.data();
+  validate_stream.in_buf_size = in.size();
+  assert(qoi_decode(&validate_stream) == QOI_STATUS_DONE);
+  assert(validate_stream.total_pixels == count);
+}
+
+int main() {
+  test_reference();
+  test_565();
+  test_stride();
+  test_near_lossless();
+  test_dictionary();
+  test_extended();
+  return 0;
+}
@@ -0,0 +1,822 @@
+#include <algorithm>
+#include <cmath>
+
+#include "qoi_encode.h"
+#include "test_util.h"
+
+static const size_t chunks[] = {1, 7, SIZE_MAX};
+
+// Decodes `in` with the options in `settings` over the bytes in `out`,
+// feeding the input `chunk` bytes at a time and offering the output
+// `out_chunk` bytes at a time, and returns the output.
+static bytes decode_onto(const bytes& in, const qoi_stream& settings,
+                         bytes out, size_t chunk,
+                         size_t out_chunk = SIZE_MAX) {
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = settings;
+  stream.decoder_state = &decoder;
+  size_t pos = 0;
+  size_t written = 0;
+  int r;
+  do {
+    stream.out_buf = out.data() + written;
+    stream.out_buf_size = out.size() - written;
+    if (stream.out_buf_size > out_chunk) stream.out_buf_size = out_chunk;
+    r = test_decode(&stream, in, &pos, chunk);
+    written = stream.out_buf - out.data();
+  } while (r == QOI_STATUS_OUTPUT_EXHAUSTED);
+  assert(r == QOI_STATUS_DONE);
+  assert(written == out.size());
+  return out;
+}
+
+// As `decode_onto`, into `out_size` zeroed bytes.
+static bytes decode(const bytes& in, const qoi_stream& settings,
+                    size_t out_size, size_t chunk,
+                    size_t out_chunk = SIZE_MAX) {
+  return decode_onto(in, settings, bytes(out_size), chunk, out_chunk);
+}
+
+// Checks the byte orders of `QOI_FORMAT_RGB` to `QOI_FORMAT_ABGR` for
+// both channel counts, with output space that splits pixels.
+static void test_swizzle() {
+  // Source channel of each output byte, where 3 is alpha.
+  static const struct {
+    uint8_t format;
+    uint8_t size;
+    uint8_t order[4];
+  } formats[] = {
+      {QOI_FORMAT_RGB, 3, {0, 1, 2}},     {QOI_FORMAT_BGR, 3, {2, 1, 0}},
+      {QOI_FORMAT_RGBA, 4, {0, 1, 2, 3}}, {QOI_FORMAT_BGRA, 4, {2, 1, 0, 3}},
+      {QOI_FORMAT_ARGB, 4, {3, 0, 1, 2}}, {QOI_FORMAT_ABGR, 4, {3, 2, 1, 0}},
+  };
+
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {19, 11, channels, 0};
+    const size_t count = 19 * 11;
+    const bytes pixels = test_image(19, 11, channels, 31);
+    const bytes in = test_encode(desc, pixels);
+    for (auto format : formats) {
+      bytes expected(count * format.size);
+      for (size_t i = 0; i < count; ++i) {
+        const uint32_t pixel = test_pixel(pixels, i, channels);
+        for (int k = 0; k < format.size; ++k)
+          expected[i * format.size + k] = pixel >> (8 * format.order[k]);
+      }
+      qoi_stream settings = {};
+      settings.format = format.format;
+      for (size_t chunk : chunks)
+        assert(decode(in, settings, expected.size(), chunk) == expected);
+      assert(decode(in, settings, expected.size(), SIZE_MAX, 5) == expected);
+    }
+  }
+}
+
+// Reference luma of a pixel, with the decoder's integer weights.
+static uint8_t luma(uint32_t pixel, bool bt709) {
+  const uint32_t r = pixel & 0xFF;
+  const uint32_t g = (pixel >> 8) & 0xFF;
+  const uint32_t b = (pixel >> 16) & 0xFF;
+  if (bt709) return (54 * r + 183 * g + 19 * b + 128) >> 8;
+  return (77 * r + 150 * g + 29 * b + 128) >> 8;
+}
+
+// Packs one bit per value of a `width` by `height` image, most
+// significant bit first, with each row starting on a new byte.
+static bytes pack_bits(const std::vector<bool>& bits, uint32_t width,
+                       uint32_t height) {
+  const size_t stride = (width + 7) / 8;
+  bytes out(stride * height);
+  for (size_t y = 0; y < height; ++y)
+    for (size_t x = 0; x < width; ++x)
+      if (bits[y * width + x]) out[y * stride + x / 8] |= 0x80 >> (x % 8);
+  return out;
+}
+
+// Checks `QOI_FORMAT_GRAY8` with both sets of weights, and
+// `QOI_FORMAT_MONO1` with a threshold and with `QOI_FLAG_DITHER`, on an
+// image whose rows end part way through a byte.
+static void test_gray_mono() {
+  static const uint8_t dither[4][4] = {
+      {8, 136, 40, 168},
+      {200, 72, 232, 104},
+      {56, 184, 24, 152},
+      {248, 120, 216, 88},
+  };
+  const uint32_t width = 19, height = 11;
+  const size_t count = width * height;
+
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {width, height, channels, 0};
+    const bytes pixels = test_image(width, height, channels, 32);
+    const bytes in = test_encode(desc, pixels);
+
+    for (bool bt709 : {false, true}) {
+      bytes gray(count);
+      for (size_t i = 0; i < count; ++i)
+        gray[i] = luma(test_pixel(pixels, i, channels), bt709);
+      qoi_stream settings = {};
+      settings.format = QOI_FORMAT_GRAY8;
+      settings.flags = bt709 ? QOI_FLAG_BT709 : 0;
+      for (size_t chunk : chunks)
+        assert(decode(in, settings, count, chunk) == gray);
+
+      std::vector<bool> above(count), dithered(count);
+      for (size_t i = 0; i < count; ++i) {
+        above[i] = gray[i] > 100;
+        dithered[i] = gray[i] > dither[i / width % 4][i % width % 4];
+      }
+      const bytes mono = pack_bits(above, width, height);
+      const bytes mono_dithered = pack_bits(dithered, width, height);
+      assert(mono != mono_dithered);
+      settings.format = QOI_FORMAT_MONO1;
+      settings.threshold = 100;
+      for (size_t chunk : chunks) {
+        assert(decode(in, settings, mono.size(), chunk) == mono);
+        settings.flags |= QOI_FLAG_DITHER;
+        assert(decode(in, settings, mono.size(), chunk) == mono_dithered);
+        settings.flags &= ~QOI_FLAG_DITHER;
+      }
+    }
+  }
+}
+
+// Checks `QOI_FORMAT_ALPHA8` and `QOI_FORMAT_ALPHA1`, and
+// `row_summary` on an image with transparent rows, some of them
+// covered by a single run.
+static void test_alpha() {
+  const uint32_t width = 19, height = 11;
+  const size_t count = width * height;
+  const bool clear_rows[height] = {0, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {width, height, channels, 0};
+    bytes pixels = test_image(width, height, channels, 33);
+    if (channels == 4) {
+      for (size_t i = 0; i < count; ++i)
+        if (clear_rows[i / width]) memset(pixels.data() + i * 4, 0, 4);
+    }
+    const bytes in = test_encode(desc, pixels);
+
+    bytes alpha(count);
+    std::vector<bool> above(count);
+    bytes summary(2);
+    for (size_t i = 0; i < count; ++i) {
+      alpha[i] = test_pixel(pixels, i, channels) >> 24;
+      above[i] = alpha[i] > 0x80;
+      if (alpha[i] > 0x80) summary[i / width / 8] |= 0x80 >> (i / width % 8);
+    }
+    assert(summary[0] == (channels == 3 ? 0xFF : 0x8E));
+    const bytes packed = pack_bits(above, width, height);
+
+    for (size_t chunk : chunks) {
+      qoi_stream settings = {};
+      settings.format = QOI_FORMAT_ALPHA8;
+      assert(decode(in, settings, count, chunk) == alpha);
+      settings.format = QOI_FORMAT_ALPHA1;
+      settings.threshold = 0x80;
+      assert(decode(in, settings, packed.size(), chunk) == packed);
+
+      // The summary is computed alongside any output format.
+      bytes row_summary(3, 0);
+      settings.format = QOI_FORMAT_NATIVE;
+      settings.row_summary = row_summary.data();
+      settings.row_summary_size = 2;
+      assert(decode(in, settings, pixels.size(), chunk) == pixels);
+      assert(bytes(row_summary.begin(), row_summary.end() - 1) == summary);
+      assert(row_summary[2] == 0);
+    }
+  }
+}
+
+// Divides by 255 with rounding.
+static uint32_t div255(uint32_t x) { return (2 * x + 255) / 510; }
+
+// Returns the 16-bit value of a pixel in `QOI_FORMAT_RGB565`, or its
+// red, green and blue fields.
+static uint16_t rgb565(uint32_t pixel) {
+  return (pixel & 0xF8) << 8 | (pixel & 0xFC00) >> 5 | (pixel >> 19 & 0x1F);
+}
+
+static void fields565(uint16_t v, uint32_t c[3]) {
+  c[0] = v >> 11;
+  c[1] = (v >> 5) & 0x3F;
+  c[2] = v & 0x1F;
+}
+
+// Checks `QOI_FORMAT_RGB565` and `QOI_FORMAT_BGR565`, which differ in
+// the order of the fields and of the bytes.
+static void test_565() {
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {19, 11, channels, 0};
+    const size_t count = 19 * 11;
+    const bytes pixels = test_image(19, 11, channels, 34);
+    const bytes in = test_encode(desc, pixels);
+
+    bytes rgb(count * 2), bgr(count * 2);
+    for (size_t i = 0; i < count; ++i) {
+      const uint16_t v = rgb565(test_pixel(pixels, i, channels));
+      uint32_t c[3];
+      fields565(v, c);
+      const uint16_t swapped = c[2] << 11 | c[1] << 5 | c[0];
+      rgb[i * 2] = v;
+      rgb[i * 2 + 1] = v >> 8;
+      bgr[i * 2] = swapped >> 8;
+      bgr[i * 2 + 1] = swapped;
+    }
+    qoi_stream settings = {};
+    for (size_t chunk : chunks) {
+      settings.format = QOI_FORMAT_RGB565;
+      assert(decode(in, settings, rgb.size(), chunk) == rgb);
+      assert(decode(in, settings, rgb.size(), chunk, 3) == rgb);
+      settings.format = QOI_FORMAT_BGR565;
+      assert(decode(in, settings, bgr.size(), chunk) == bgr);
+    }
+  }
+}
+
+// Checks `QOI_FLAG_PREMULTIPLY`, `QOI_FLAG_BLEND_COLOR` and
+// `QOI_FLAG_BLEND_DEST`, the latter with and without premultiplied
+// alpha, in `QOI_FORMAT_RGBA` and `QOI_FORMAT_RGB565`.
+static void test_compose() {
+  const qoi_desc desc = {19, 11, 4, 0};
+  const size_t count = 19 * 11;
+  const bytes pixels = test_image(19, 11, 4, 34);
+  const bytes in = test_encode(desc, pixels);
+  const uint32_t background = 0xFF3080D0;
+
+  bytes premultiplied(count * 4), blended(count * 4);
+  for (size_t i = 0; i < count; ++i) {
+    const uint32_t a = pixels[i * 4 + 3];
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t c = pixels[i * 4 + k];
+      const uint32_t bg = (background >> (8 * k)) & 0xFF;
+      premultiplied[i * 4 + k] = div255(c * a);
+      blended[i * 4 + k] = div255(c * a + bg * (255 - a));
+    }
+    premultiplied[i * 4 + 3] = a;
+    blended[i * 4 + 3] = 255;
+  }
+
+  // A destination with every level of each channel.
+  bytes dest(count * 4);
+  for (size_t i = 0; i < dest.size(); ++i) dest[i] = i * 37;
+
+  // Straight and premultiplied "over", with alpha always combined as
+  // `a + d * (1 - a)`.
+  bytes over(count * 4), over_premultiplied(count * 4);
+  bytes over565(count * 2), over565_premultiplied(count * 2);
+  for (size_t i = 0; i < count; ++i) {
+    const uint32_t a = pixels[i * 4 + 3];
+    for (int k = 0; k < 4; ++k) {
+      const uint32_t d = dest[i * 4 + k];
+      const uint32_t p = premultiplied[i * 4 + k];
+      const uint32_t straight =
+          (k == 3) ? p + div255(d * (255 - a))
+                   : div255(pixels[i * 4 + k] * a + d * (255 - a));
+      over[i * 4 + k] = (a == 0) ? d : std::min(straight, 255u);
+      over_premultiplied[i * 4 + k] =
+          (a == 0) ? d : std::min(p + div255(d * (255 - a)), 255u);
+    }
+
+    uint16_t d565;
+    memcpy(&d565, dest.data() + i * 2, 2);
+    uint32_t src[3], p[3], dst[3], c[3], c_premultiplied[3];
+    fields565(rgb565(test_pixel(pixels, i, 4)), src);
+    fields565(rgb565(premultiplied[i * 4] | premultiplied[i * 4 + 1] << 8 |
+                     premultiplied[i * 4 + 2] << 16),
+              p);
+    fields565(d565, dst);
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t max = (k == 1) ? 0x3F : 0x1F;
+      c[k] = std::min(div255(src[k] * a + dst[k] * (255 - a)), max);
+      c_premultiplied[k] = std::min(p[k] + div255(dst[k] * (255 - a)), max);
+    }
+    uint16_t v = c[0] << 11 | c[1] << 5 | c[2];
+    uint16_t v_premultiplied =
+        c_premultiplied[0] << 11 | c_premultiplied[1] << 5 | c_premultiplied[2];
+    if (a == 0) v = v_premultiplied = d565;
+    if (a == 255) v = v_premultiplied = rgb565(test_pixel(pixels, i, 4));
+    memcpy(over565.data() + i * 2, &v, 2);
+    memcpy(over565_premultiplied.data() + i * 2, &v_premultiplied, 2);
+  }
+
+  for (size_t chunk : chunks) {
+    qoi_stream settings = {};
+    settings.flags = QOI_FLAG_PREMULTIPLY;
+    assert(decode(in, settings, count * 4, chunk) == premultiplied);
+    settings.flags = QOI_FLAG_BLEND_COLOR;
+    settings.background = background;
+    assert(decode(in, settings, count * 4, chunk) == blended);
+
+    settings.format = QOI_FORMAT_RGBA;
+    settings.flags = QOI_FLAG_BLEND_DEST;
+    assert(decode_onto(in, settings, dest, chunk) == over);
+    settings.flags |= QOI_FLAG_PREMULTIPLY;
+    assert(decode_onto(in, settings, dest, chunk) == over_premultiplied);
+
+    const bytes dest565(dest.begin(), dest.begin() + count * 2);
+    settings.format = QOI_FORMAT_RGB565;
+    settings.flags = QOI_FLAG_BLEND_DEST;
+    assert(decode_onto(in, settings, dest565, chunk) == over565);
+    settings.flags |= QOI_FLAG_PREMULTIPLY;
+    assert(decode_onto(in, settings, dest565, chunk) == over565_premultiplied);
+  }
+
+  // Output is only blended a whole pixel at a time, so space for part
+  // of a pixel is left unused.
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = {};
+  stream.format = QOI_FORMAT_RGBA;
+  stream.flags = QOI_FLAG_BLEND_DEST;
+  stream.decoder_state = &decoder;
+  bytes out = dest;
+  stream.out_buf = out.data();
+  stream.out_buf_size = 6;
+  size_t pos = 0;
+  assert(test_decode(&stream, in, &pos, SIZE_MAX) ==
+         QOI_STATUS_OUTPUT_EXHAUSTED);
+  assert(stream.out_buf == out.data() + 4 && stream.out_buf_size == 2);
+  stream.out_buf_size = out.size() - 4;
+  assert(test_decode(&stream, in, &pos, SIZE_MAX) == QOI_STATUS_DONE);
+  assert(out == over);
+}
+
+// Checks `lut` with and without the alpha table, including a run that
+// crosses rows, on its own and ahead of `QOI_FORMAT_GRAY8` and of
+// `QOI_FORMAT_RGB565` with `QOI_FLAG_PREMULTIPLY`.
+static void test_lut() {
+  // Tables that move every value, so that an unmapped channel shows.
+  uint8_t lut[1024];
+  for (int i = 0; i < 256; ++i) {
+    lut[i] = 255 - i;
+    lut[256 + i] = i * 7 + 3;
+    lut[512 + i] = i ^ 0x5A;
+    lut[768 + i] = i / 2 + 64;
+  }
+  const uint32_t width = 19, height = 11;
+  const size_t count = width * height;
+
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {width, height, channels, 0};
+    bytes pixels = test_image(width, height, channels, 35);
+    for (size_t i = 30; i < 70; ++i)
+      memcpy(pixels.data() + i * channels, pixels.data() + 29 * channels,
+             channels);
+    const bytes in = test_encode(desc, pixels);
+
+    for (size_t lut_size : {768, 1024}) {
+      bytes rgba(count * 4), gray(count), premultiplied565(count * 2);
+      for (size_t i = 0; i < count; ++i) {
+        const uint32_t pixel = test_pixel(pixels, i, channels);
+        uint32_t a = pixel >> 24;
+        if (lut_size == 1024 && channels == 4) a = lut[768 + a];
+        uint32_t mapped = a << 24;
+        for (int k = 0; k < 3; ++k)
+          mapped |= uint32_t(lut[256 * k + ((pixel >> (8 * k)) & 0xFF)])
+                    << (8 * k);
+        memcpy(rgba.data() + i * 4, &mapped, 4);
+        gray[i] = luma(mapped, false);
+
+        uint32_t p = a << 24;
+        for (int k = 0; k < 3; ++k)
+          p |= div255(((mapped >> (8 * k)) & 0xFF) * a) << (8 * k);
+        const uint16_t v = rgb565(p);
+        memcpy(premultiplied565.data() + i * 2, &v, 2);
+      }
+
+      qoi_stream settings = {};
+      settings.lut = lut;
+      settings.lut_size = lut_size;
+      for (size_t chunk : chunks) {
+        settings.format = QOI_FORMAT_RGBA;
+        settings.flags = 0;
+        assert(decode(in, settings, rgba.size(), chunk) == rgba);
+        settings.format = QOI_FORMAT_GRAY8;
+        assert(decode(in, settings, gray.size(), chunk) == gray);
+        settings.format = QOI_FORMAT_RGB565;
+        settings.flags = QOI_FLAG_PREMULTIPLY;
+        assert(decode(in, settings, premultiplied565.size(), chunk) ==
+               premultiplied565);
+      }
+    }
+  }
+
+  // Table sizes other than 768 and 1024, and a size without a table,
+  // are refused.
+  const qoi_desc desc = {width, height, 4, 0};
+  const bytes in = test_encode(desc, test_image(width, height, 4, 35));
+  for (size_t lut_size : {256, 768}) {
+    qoi_decoder_state decoder;
+    qoi_decoder_state_init(&decoder);
+    qoi_stream stream = {};
+    stream.decoder_state = &decoder;
+    stream.lut = (lut_size == 256) ? lut : nullptr;
+    stream.lut_size = lut_size;
+    bytes out(count * 4);
+    stream.out_buf = out.data();
+    stream.out_buf_size = out.size();
+    size_t pos = 0;
+    assert(test_decode(&stream, in, &pos, SIZE_MAX) == QOI_STATUS_ERR_PARAM);
+  }
+}
+
+// Checks `QOI_FORMAT_LINEAR16` and `QOI_FORMAT_LINEAR32F` for sRGB and
+// linear images, against the sRGB transfer function.
+static void test_linear() {
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    for (uint8_t colorspace : {0, 4}) {
+      const qoi_desc desc = {19, 11, channels, colorspace};
+      const size_t count = 19 * 11;
+      const bytes pixels = test_image(19, 11, channels, 36);
+      const bytes in = test_encode(desc, pixels);
+
+      std::vector<uint16_t> linear16(count * channels);
+      std::vector<float> linear32f(count * channels);
+      for (size_t i = 0; i < linear16.size(); ++i) {
+        const double v = pixels[i] / 255.0;
+        double l = v;
+        if (colorspace == 0 && i % channels < 3)
+          l = (v <= 0.04045) ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+        linear16[i] = std::lround(l * 65535);
+        linear32f[i] = linear16[i] * (1.0f / 65535);
+      }
+
+      qoi_stream settings = {};
+      for (size_t chunk : chunks) {
+        settings.format = QOI_FORMAT_LINEAR16;
+        bytes out = decode(in, settings, count * channels * 2, chunk, 5);
+        assert(memcmp(out.data(), linear16.data(), out.size()) == 0);
+        settings.format = QOI_FORMAT_LINEAR32F;
+        out = decode(in, settings, count * channels * 4, chunk, 7);
+        assert(memcmp(out.data(), linear32f.data(), out.size()) == 0);
+      }
+    }
+  }
+
+  // Only the colorspaces of the specification are accepted.
+  const qoi_desc desc = {1, 1, 3, 0};
+  bytes in = test_encode(desc, bytes(3));
+  in[13] = 1;
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = {};
+  stream.decoder_state = &decoder;
+  bytes out(3);
+  assert(test_decode_all(&stream, in, &out, SIZE_MAX) ==
+         QOI_STATUS_ERR_FORMAT);
+  const qoi_desc linear = {1, 1, 3, 1};
+  qoi_encoder_state encoder;
+  qoi_encoder_state_init(&encoder);
+  qoi_encode_stream encode = {};
+  encode.desc = linear;
+  encode.in_buf = out.data();
+  encode.in_buf_size = out.size();
+  encode.out_buf = in.data();
+  encode.out_buf_size = in.size();
+  encode.encoder_state = &encoder;
+  assert(qoi_encode(&encode) == QOI_STATUS_ERR_PARAM);
+}
+
+// Checks `QOI_FLAG_NORMALIZE` in a swizzled format and in the
+// single-channel formats, with a scale and bias for each output
+// channel.
+static void test_normalize() {
+  const qoi_desc desc = {19, 11, 4, 0};
+  const size_t count = 19 * 11;
+  const bytes pixels = test_image(19, 11, 4, 36);
+  const bytes in = test_encode(desc, pixels);
+  static const struct {
+    uint8_t format;
+    uint8_t size;
+    uint8_t order[4];
+  } formats[] = {
+      {QOI_FORMAT_BGR, 3, {2, 1, 0}},
+      {QOI_FORMAT_ARGB, 4, {3, 0, 1, 2}},
+      {QOI_FORMAT_GRAY8, 1, {4}},
+      {QOI_FORMAT_ALPHA8, 1, {3}},
+  };
+
+  qoi_stream settings = {};
+  settings.flags = QOI_FLAG_NORMALIZE;
+  for (int k = 0; k < 4; ++k) {
+    settings.scale[k] = 1.0f / (58 + k);
+    settings.bias[k] = -0.25f * k;
+  }
+  for (auto format : formats) {
+    std::vector<float> expected(count * format.size);
+    for (size_t i = 0; i < count; ++i) {
+      const uint32_t pixel = test_pixel(pixels, i, 4);
+      for (int k = 0; k < format.size; ++k) {
+        const uint8_t channel = format.order[k];
+        const uint8_t value =
+            (channel == 4) ? luma(pixel, false) : pixel >> (8 * channel);
+        expected[i * format.size + k] =
+            value * settings.scale[k] + settings.bias[k];
+      }
+    }
+    settings.format = format.format;
+    for (size_t chunk : chunks) {
+      const bytes out =
+          decode(in, settings, expected.size() * sizeof(float), chunk, 6);
+      assert(memcmp(out.data(), expected.data(), out.size()) == 0);
+    }
+  }
+}
+
+// Checks `QOI_FLAG_PLANAR` with a gap between the planes, which must
+// be left untouched, with 8-bit channels and with `QOI_FLAG_NORMALIZE`.
+static void test_planar() {
+  const qoi_desc desc = {19, 11, 4, 0};
+  const size_t count = 19 * 11;
+  const bytes pixels = test_image(19, 11, 4, 37);
+  const bytes in = test_encode(desc, pixels);
+
+  for (bool normalize : {false, true}) {
+    const size_t element = normalize ? sizeof(float) : 1;
+    const size_t pitch = count * element + 13;
+    qoi_stream settings = {};
+    settings.format = QOI_FORMAT_BGRA;
+    settings.flags = QOI_FLAG_PLANAR | (normalize ? QOI_FLAG_NORMALIZE : 0);
+    settings.plane_pitch = pitch;
+    for (int k = 0; k < 4; ++k) {
+      settings.scale[k] = 1.0f / 255;
+      settings.bias[k] = -0.5f;
+    }
+
+    bytes expected(4 * pitch, 0xAA);
+    const uint8_t order[4] = {2, 1, 0, 3};
+    for (size_t i = 0; i < count; ++i) {
+      for (int k = 0; k < 4; ++k) {
+        const uint8_t value = pixels[i * 4 + order[k]];
+        const float f = value * settings.scale[k] + settings.bias[k];
+        memcpy(expected.data() + k * pitch + i * element,
+               normalize ? (const void*)&f : &value, element);
+      }
+    }
+
+    for (size_t chunk : chunks) {
+      for (size_t out_chunk : {element, 10 * element, SIZE_MAX}) {
+        qoi_decoder_state decoder;
+        qoi_decoder_state_init(&decoder);
+        qoi_stream stream = settings;
+        stream.decoder_state = &decoder;
+        bytes out(4 * pitch, 0xAA);
+        size_t pos = 0;
+        size_t written = 0;
+        int r;
+        do {
+          stream.out_buf = out.data() + written;
+          stream.out_buf_size = std::min(count * element - written, out_chunk);
+          r = test_decode(&stream, in, &pos, chunk);
+          written = stream.out_buf - out.data();
+        } while (r == QOI_STATUS_OUTPUT_EXHAUSTED);
+        assert(r == QOI_STATUS_DONE);
+        assert(written == count * element);
+        assert(out == expected);
+      }
+    }
+  }
+}
+
+// Checks `QOI_FORMAT_INDEX8` with a table from `qoi_palette_lut`,
+// against a search for the palette colour nearest the centre of each
+// pixel's cell, for an opaque image and for one blended over a colour.
+static void test_index8() {
+  uint32_t palette[16];
+  for (uint32_t i = 0; i < 16; ++i)
+    palette[i] = 0xFF000000 | (i & 1) * 0xE0 | (i >> 1 & 1) * 0xE000 |
+                 (i >> 2 & 1) * 0xE00000 | (i >> 3) * 0x101010;
+  bytes lut(QOI_PALETTE_LUT_SIZE);
+  qoi_palette_lut(palette, 16, lut.data());
+
+  // Each colour of the palette is the nearest to its own cell.
+  for (uint32_t i = 0; i < 16; ++i) {
+    const uint32_t c = palette[i];
+    assert(lut[(c & 0xF0) << 4 | (c >> 8 & 0xF0) | (c >> 20 & 0x0F)] == i);
+  }
+
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    const qoi_desc desc = {19, 11, channels, 0};
+    const size_t count = 19 * 11;
+    const bytes pixels = test_image(19, 11, channels, 38);
+    const bytes in = test_encode(desc, pixels);
+    qoi_stream settings = {};
+    settings.format = QOI_FORMAT_INDEX8;
+    settings.palette_lut = lut.data();
+    if (channels == 4) {
+      settings.flags = QOI_FLAG_BLEND_COLOR;
+      settings.background = 0xFF204060;
+    }
+
+    bytes expected(count);
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t pixel = test_pixel(pixels, i, channels);
+      if (channels == 4) {
+        const uint32_t a = pixel >> 24;
+        uint32_t blended = 0;
+        for (int shift = 0; shift < 24; shift += 8) {
+          const uint32_t c = (pixel >> shift) & 0xFF;
+          const uint32_t bg = (settings.background >> shift) & 0xFF;
+          blended |= div255(c * a + bg * (255 - a)) << shift;
+        }
+        pixel = blended;
+      }
+      uint32_t best = UINT32_MAX;
+      for (uint32_t k = 0; k < 16; ++k) {
+        uint32_t distance = 0;
+        for (int shift = 0; shift < 24; shift += 8) {
+          const int centre = (pixel >> shift & 0xF0) + 8;
+          const int d = centre - int(palette[k] >> shift & 0xFF);
+          distance += d * d;
+        }
+        if (distance < best) {
+          best = distance;
+          expected[i] = k;
+        }
+      }
+    }
+    for (size_t chunk : chunks)
+      assert(decode(in, settings, count, chunk) == expected);
+  }
+}
+
+// Returns a 4-channel image with areas of `key`, including runs that
+// cross rows and single pixels whose alpha differs.
+static bytes keyed_image(uint32_t width, uint32_t height, uint32_t key,
+                         uint32_t seed) {
+  bytes pixels = test_image(width, height, 4, seed);
+  for (size_t i = 0; i < size_t(width) * height; ++i) {
+    const size_t x = i % width, y = i / width;
+    if ((y >= 2 && y < 5 && x >= 5 && x < 15) ||
+        (y * width + x >= 7 * width - 4 && y < 9) || i % 17 == 3) {
+      const uint32_t pixel = key | ((i % 17 == 3) ? i << 24 : 0xFF000000);
+      memcpy(pixels.data() + i * 4, &pixel, 4);
+    }
+  }
+  return pixels;
+}
+
+// Checks `QOI_FLAG_COLOR_KEY`, which leaves the destination of keyed
+// pixels untouched, and `QOI_FLAG_KEY_SPANS`, which reports the spans
+// of other pixels and writes them contiguously.
+static void test_color_key() {
+  const uint32_t width = 23, height = 13, key = 0x10F020;
+  const size_t count = width * height;
+  const qoi_desc desc = {width, height, 4, 0};
+  const bytes pixels = keyed_image(width, height, key, 39);
+  const bytes in = test_encode(desc, pixels);
+
+  const bytes dest(count * 4, 0xAA);
+  bytes expected = dest;
+  std::vector<bool> keyed(count);
+  for (size_t i = 0; i < count; ++i) {
+    keyed[i] = (test_pixel(pixels, i, 4) & 0xFFFFFF) == key;
+    if (!keyed[i]) memcpy(expected.data() + i * 4, pixels.data() + i * 4, 4);
+  }
+
+  qoi_stream settings = {};
+  settings.flags = QOI_FLAG_COLOR_KEY;
+  settings.color_key = key | 0x12000000;
+  for (size_t chunk : chunks) {
+    assert(decode_onto(in, settings, dest, chunk) == expected);
+    assert(decode_onto(in, settings, dest, chunk, 6) == expected);
+  }
+
+  settings.flags |= QOI_FLAG_KEY_SPANS;
+  for (size_t chunk : chunks) {
+    qoi_decoder_state decoder;
+    qoi_decoder_state_init(&decoder);
+    qoi_stream stream = settings;
+    stream.decoder_state = &decoder;
+    bytes canvas = dest;
+    size_t pos = 0;
+    size_t spans = 0;
+    int r;
+    while ((r = test_decode(&stream, in, &pos, chunk)) ==
+           QOI_STATUS_OPAQUE_SPAN) {
+      // Each span starts at a pixel that is not keyed, after a keyed
+      // pixel or at the start of a row, and may extend to its end.
+      const size_t offset = stream.span.offset;
+      assert(!keyed[offset]);
+      assert(offset % width == 0 || keyed[offset - 1]);
+      assert(stream.span.length == width - offset % width);
+      stream.out_buf = canvas.data() + offset * 4;
+      stream.out_buf_size = stream.span.length * 4;
+      spans += 1;
+    }
+    assert(r == QOI_STATUS_DONE);
+    assert(canvas == expected);
+
+    size_t expected_spans = 0;
+    for (size_t i = 0; i < count; ++i)
+      expected_spans += !keyed[i] && (i % width == 0 || keyed[i - 1]);
+    assert(spans == expected_spans);
+  }
+}
+
+// Decodes `in` as `QOI_FORMAT_RGBA` with `QOI_FLAG_RUNS` onto `out`,
+// filling each reported run and placing the other pixels after it.
+// Returns the number of runs, and appends their lengths to `lengths`.
+static size_t decode_runs(const bytes& in, const qoi_stream& settings,
+                          bytes* out, size_t chunk,
+                          std::vector<size_t>* lengths) {
+  qoi_decoder_state decoder;
+  qoi_decoder_state_init(&decoder);
+  qoi_stream stream = settings;
+  stream.format = QOI_FORMAT_RGBA;
+  stream.flags |= QOI_FLAG_RUNS;
+  stream.decoder_state = &decoder;
+  stream.out_buf = out->data();
+  stream.out_buf_size = out->size();
+  size_t pos = 0;
+  size_t runs = 0;
+  int r;
+  while ((r = test_decode(&stream, in, &pos, chunk)) == QOI_STATUS_RUN) {
+    const size_t end = stream.span.offset + stream.span.length;
+    assert(stream.out_buf == out->data() + stream.span.offset * 4);
+    for (size_t i = stream.span.offset; i < end; ++i)
+      memcpy(out->data() + i * 4, &stream.run_color, 4);
+    stream.out_buf = out->data() + end * 4;
+    stream.out_buf_size = out->size() - end * 4;
+    lengths->push_back(stream.span.length);
+    runs += 1;
+  }
+  assert(r == QOI_STATUS_DONE);
+  return runs;
+}
+
+// Checks `QOI_FLAG_RUNS`: runs longer than one opcode are reported
+// once, runs past the end of the image are cut short, and keyed runs
+// are dropped.
+static void test_runs() {
+  const uint32_t width = 23, height = 13;
+  const size_t count = width * height;
+  const qoi_desc desc = {width, height, 4, 0};
+  bytes pixels = test_image(width, height, 4, 40);
+  // A run across several rows and opcodes, and one that ends the image.
+  const uint32_t colors[2] = {0xFF10F020, 0x80402010};
+  for (size_t i = 30; i < 230; ++i) memcpy(pixels.data() + i * 4, colors, 4);
+  for (size_t i = count - 40; i < count; ++i)
+    memcpy(pixels.data() + i * 4, colors + 1, 4);
+  const bytes in = test_encode(desc, pixels);
+
+  for (size_t chunk : chunks) {
+    bytes out(count * 4);
+    std::vector<size_t> lengths;
+    decode_runs(in, {}, &out, chunk, &lengths);
+    assert(out == pixels);
+    // With all of the input at hand, each run is reported whole.
+    if (chunk == SIZE_MAX) {
+      assert(std::count(lengths.begin(), lengths.end(), 199) == 1);
+      assert(lengths.back() == 39);
+    }
+
+    // Keyed runs are dropped, leaving their pixels untouched, and the
+    // pixels after them are still written in place.
+    qoi_stream settings = {};
+    settings.flags = QOI_FLAG_COLOR_KEY;
+    settings.color_key = colors[0];
+    bytes expected = pixels;
+    memset(expected.data() + 30 * 4, 0xAA, 200 * 4);
+    out.assign(count * 4, 0xAA);
+    lengths.clear();
+    decode_runs(in, settings, &out, chunk, &lengths);
+    assert(out == expected);
+    assert(std::count(lengths.begin(), lengths.end(), 199) == 0);
+  }
+
+  // Two run opcodes coding 8 pixels after the first, in an image of 4,
+  // are merged and cut short.
+  const unsigned char short_image[] = {
+      'q', 'o', 'i', 'f', 0, 0, 0, 4, 0, 0, 0, 1, 4, 0,
+      0b11111110, 1, 2, 3, 0b11000001, 0b11000101,
+      0, 0, 0, 0, 0, 0, 0, 1};
+  const bytes short_in(short_image, short_image + sizeof(short_image));
+  for (size_t chunk : chunks) {
+    bytes out(4 * 4);
+    std::vector<size_t> lengths;
+    assert(decode_runs(short_in, {}, &out, chunk, &lengths) >= 1);
+    for (size_t i = 0; i < 4; ++i)
+      assert(test_pixel(out, i, 4) == 0xFF030201);
+    if (chunk == SIZE_MAX) assert(lengths == std::vector<size_t>{3});
+  }
+}
+
+int main() {
+  test_swizzle();
+  test_gray_mono();
+  test_alpha();
+  test_565();
+  test_compose();
+  test_lut();
+  test_linear();
+  test_normalize();
+  test_planar();
+  test_index8();
+  test_color_key();
+  test_runs();
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include <algorithm>
+
+#include "qoi_encode_host.h"
+#include "qoi_lz.h"
+#include "test_util.h"
+
+// Checks that `qoi_encode_host` and `qoi_encode_host_parallel` produce
+// the same output as the reference encoder. Built both with and
+// without AVX2, which changes how `qoi_encode_host` classifies pixels.
+static void test_host(const qoi_desc& desc, const bytes& pixels) {
+  const bytes expected = test_encode(desc, pixels);
+  bytes out(QOI_ENCODE_SIZE_MAX(&desc));
+  assert(qoi_encode_host(&desc, pixels.data(), out.data(), out.size()) ==
+         expected.size());
+  assert(bytes(out.begin(), out.begin() + expected.size()) == expected);
+
+  for (uint32_t bands : {1u, 2u, 5u, desc.height}) {
+    if (bands > desc.height) continue;
+    out.assign(out.size(), 0);
+    assert(qoi_encode_host_parallel(&desc, pixels.data(), out.data(),
+                                    out.size(), bands, 3,
+                                    nullptr) == expected.size());
+    assert(bytes(out.begin(), out.begin() + expected.size()) == expected);
+  }
+}
+
+// Encodes an image in `bands` bands with checkpoints, and decodes each
+// band on its own, starting from its checkpoint, with
+// `qoi_decode_resume`.
+static void test_checkpoints(const qoi_desc& desc, const bytes& pixels,
+                             uint32_t bands) {
+  const bytes expected = test_encode(desc, pixels);
+  bytes in(QOI_ENCODE_SIZE_MAX(&desc));
+  std::vector<qoi_checkpoint> checkpoints(bands);
+  assert(qoi_encode_host_parallel(&desc, pixels.data(), in.data(), in.size(),
+                                  bands, 2, checkpoints.data()) ==
+         expected.size());
+  in.resize(expected.size());
+  assert(in == expected);
+
+  // More bands than rows give one band per row.
+  if (bands > desc.height) bands = desc.height;
+  const size_t count = size_t(desc.width) * desc.height;
+  for (uint32_t k = 0; k < bands; ++k) {
+    const qoi_checkpoint& checkpoint = checkpoints[k];
+    const size_t end = (k + 1 < bands) ? checkpoints[k + 1].pixel : count;
+    // A checkpoint is at the start of its band's first row, or before
+    // it when a run crosses into the band.
+    const size_t start = size_t(desc.width) * (desc.height * k / bands);
+    assert(checkpoint.pixel <= start);
+    assert(k > 0 || (checkpoint.pixel == 0 && checkpoint.offset == 14));
+
+    qoi_decoder_state decoder;
+    qoi_stream stream = {};
+    stream.desc = desc;
+    stream.decoder_state = &decoder;
+    assert(qoi_decode_resume(&stream, &checkpoint) == QOI_STATUS_DONE);
+    bytes out((end - checkpoint.pixel) * desc.channels);
+    stream.out_buf = out.data();
+    stream.out_buf_size = out.size();
+    size_t pos = checkpoint.offset;
+    const int r = test_decode(&stream, in, &pos, 5);
+    assert(r == (k + 1 < bands ? QOI_STATUS_OUTPUT_EXHAUSTED
+                               : QOI_STATUS_DONE));
+    assert(stream.total_pixels == end || r == QOI_STATUS_OUTPUT_EXHAUSTED);
+    assert(bytes(pixels.begin() + checkpoint.pixel * desc.channels,
+                 pixels.begin() + end * desc.channels) == out);
+  }
+
+  // Checkpoints outside the image are rejected.
+  qoi_checkpoint outside = checkpoints[0];
+  outside.pixel = count;
+  qoi_decoder_state decoder;
+  qoi_stream stream = {};
+  stream.desc = desc;
+  stream.decoder_state = &decoder;
+  assert(qoi_decode_resume(&stream, &outside) == QOI_STATUS_ERR_PARAM);
+}
+
+// Compresses an image of repeated tiles with `qoi_lz_compress`, and
+// decodes it with `qoi_lz_decode`, feeding it the compressed input in
+// chunks of every size.
+static void test_lz() {
+  const qoi_desc desc = {48, 20, 4, 0};
+  const bytes tile = test_image(16, 5, 4, 50);
+  bytes pixels(48 * 20 * 4);
+  for (size_t y = 0; y < 20; ++y)
+    for (size_t x = 0; x < 48; ++x)
+      memcpy(pixels.data() + (y * 48 + x) * 4,
+             tile.data() + (y % 5 * 16 + x % 16) * 4, 4);
+  const bytes qoi = test_encode(desc, pixels);
+
+  bytes in(QOI_LZ_SIZE_MAX(qoi.size()));
+  const size_t n = qoi_lz_compress(qoi.data(), qoi.size(), in.data(),
+                                   in.size());
+  assert(n > 0 && n < qoi.size() / 2);
+  in.resize(n);
+  assert(memcmp(in.data(), "qoiz", 4) == 0);
+
+  static qoi_lz_decoder lz;
+  for (size_t chunk = 1; chunk <= in.size(); ++chunk) {
+    qoi_lz_init(&lz);
+    qoi_decoder_state decoder;
+    qoi_decoder_state_init(&decoder);
+    qoi_stream stream = {};
+    stream.decoder_state = &decoder;
+    bytes out(pixels.size());
+    stream.out_buf = out.data();
+    stream.out_buf_size = out.size();
+    size_t pos = 0;
+    int r;
+    while ((r = qoi_lz_decode(&lz, &stream)) == QOI_STATUS_INPUT_EXHAUSTED) {
+      assert(pos < in.size());
+      lz.in_buf = in.data() + pos;
+      lz.in_buf_size = std::min(chunk, in.size() - pos);
+      pos += lz.in_buf_size;
+    }
+    assert(r == QOI_STATUS_DONE);
+    assert(out == pixels);
+    assert(lz.total_in == in.size());
+    assert(stream.total_in == qoi.size());
+  }
+}
+
+int main() {
+#if defined(QOI_TEST_AVX2) && !defined(__AVX2__)
+#error "The AVX2 build must be compiled with AVX2 enabled."
+#endif
+  // Sizes that do and do not fill whole blocks of pixels.
+  const uint32_t sizes[][2] = {{1, 1}, {7, 3}, {8, 8}, {50, 30}, {129, 17}};
+  for (uint8_t channels = 3; channels <= 4; ++channels) {
+    for (auto size : sizes) {
+      const qoi_desc desc = {size[0], size[1], channels, 0};
+      for (uint32_t seed = 0; seed < 4; ++seed)
+        test_host(desc, test_image(size[0], size[1], channels, seed));
+
+      // Runs that end at every position within a block, and one that
+      // covers the whole image.
+      bytes pixels = test_image(size[0], size[1], channels, 42);
+      for (size_t i = 0; i < pixels.size() / channels; ++i) {
+        if (i % 11 < i % 8)
+          memset(pixels.data() + i * channels, 0x40, channels);
+      }
+      test_host(desc, pixels);
+      test_host(desc, bytes(pixels.size(), 0));
+
+      for (uint32_t bands : {1u, 3u, 7u, 1000u})
+        test_checkpoints(desc, pixels, bands);
+    }
+  }
+  test_lz();
+  return 0;
+}
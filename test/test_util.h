@@ -0,0 +1,146 @@
+#pragma once
+
+// Helpers shared by the self-contained tests, which build their own
+// images rather than reading them from files.
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "qoi_decode.h"
+
+typedef std::vector<unsigned char> bytes;
+
+// Returns pixel `i` of `pixels` with the red channel in the least
+// significant byte, as the decoder holds pixels.
+static inline uint32_t test_pixel(const bytes& pixels, size_t i,
+                                  uint8_t channels) {
+  uint32_t pixel = 0xFF000000;
+  memcpy(&pixel, pixels.data() + i * channels, channels);
+  return pixel;
+}
+
+// Returns a `width` by `height` image of `channels` bytes per pixel that
+// exercises every opcode: runs, small and large steps, repeats of
+// earlier colours and noise, with alpha changes for 4 channels.
+static inline bytes test_image(uint32_t width, uint32_t height,
+                               uint8_t channels, uint32_t seed) {
+  static const uint32_t palette[8] = {
+      0xFF000000, 0xFFFFFFFF, 0xFF2040C0, 0x80FF8000,
+      0x00000000, 0xFF10E010, 0xC0808080, 0xFF0000FF};
+  bytes pixels(size_t(width) * height * channels);
+  uint32_t state = seed * 2654435761u + 1;
+  auto next = [&state] {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  };
+
+  uint8_t c[4] = {0, 0, 0, 255};
+  for (size_t i = 0; i < size_t(width) * height; ++i) {
+    uint32_t mode = next() % 16;
+    if (mode < 6) {
+      // Repeat the previous pixel.
+    } else if (mode < 9) {
+      for (int k = 0; k < 3; ++k) c[k] += next() % 3 - 1;
+    } else if (mode < 11) {
+      uint8_t step = next() % 41 - 20;
+      for (int k = 0; k < 3; ++k) c[k] += step + next() % 9 - 4;
+    } else if (mode < 13) {
+      memcpy(c, &palette[next() % 8], 4);
+    } else if (mode < 15) {
+      for (int k = 0; k < 3; ++k) c[k] = next();
+    } else {
+      c[3] = (next() % 2) ? next() : 255;
+    }
+    if (channels == 3) c[3] = 255;
+    memcpy(pixels.data() + i * channels, c, channels);
+  }
+  return pixels;
+}
+
+// Encodes an image as a QOI file with the reference algorithm, spelled
+// out here so that the tests do not depend on the encoders they check.
+static inline bytes test_encode(const qoi_desc& desc, const bytes& pixels) {
+  bytes out = {'q', 'o', 'i', 'f'};
+  for (uint32_t v : {desc.width, desc.height})
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(v >> shift);
+  out.push_back(desc.channels);
+  out.push_back(desc.colorspace);
+
+  uint32_t index[64] = {};
+  uint32_t prev = 0xFF000000;
+  int run = 0;
+  const size_t count = size_t(desc.width) * desc.height;
+  for (size_t i = 0; i < count; ++i) {
+    const uint32_t pixel = test_pixel(pixels, i, desc.channels);
+    if (pixel == prev) {
+      if (++run == 62 || i + 1 == count) {
+        out.push_back(0b11000000 | (run - 1));
+        run = 0;
+      }
+      continue;
+    }
+    if (run > 0) {
+      out.push_back(0b11000000 | (run - 1));
+      run = 0;
+    }
+
+    uint8_t c[4], p[4];
+    memcpy(c, &pixel, 4);
+    memcpy(p, &prev, 4);
+    prev = pixel;
+    const uint8_t hash = (c[0] * 3 + c[1] * 5 + c[2] * 7 + c[3] * 11) % 64;
+    if (index[hash] == pixel) {
+      out.push_back(hash);
+      continue;
+    }
+    index[hash] = pixel;
+
+    if (c[3] != p[3]) {
+      out.insert(out.end(), {0b11111111, c[0], c[1], c[2], c[3]});
+      continue;
+    }
+    const int8_t dr = c[0] - p[0], dg = c[1] - p[1], db = c[2] - p[2];
+    const int8_t dr_dg = dr - dg, db_dg = db - dg;
+    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+      out.push_back(0b01000000 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+    } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+               db_dg >= -8 && db_dg <= 7) {
+      out.push_back(0b10000000 | (dg + 32));
+      out.push_back((dr_dg + 8) << 4 | (db_dg + 8));
+    } else {
+      out.insert(out.end(), {0b11111110, c[0], c[1], c[2]});
+    }
+  }
+  out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+  return out;
+}
+
+// Calls `qoi_decode`, passing it the input after `*pos` at most `chunk`
+// bytes at a time, until it returns anything other than
+// `QOI_STATUS_INPUT_EXHAUSTED` or the input runs out. `*pos` is left
+// after the consumed input.
+static inline int test_decode(qoi_stream* stream, const bytes& in,
+                              size_t* pos, size_t chunk) {
+  while (true) {
+    size_t size = in.size() - *pos;
+    if (size > chunk) size = chunk;
+    stream->in_buf = in.data() + *pos;
+    stream->in_buf_size = size;
+    int r = qoi_decode(stream);
+    *pos = stream->in_buf - in.data();
+    if (r != QOI_STATUS_INPUT_EXHAUSTED || size == 0) return r;
+  }
+}
+
+// Decodes a whole image into `out` with the given stream settings,
+// feeding the input `chunk` bytes at a time, and returns the final
+// status.
+static inline int test_decode_all(qoi_stream* stream, const bytes& in,
+                                  bytes* out, size_t chunk) {
+  stream->out_buf = out->data();
+  stream->out_buf_size = out->size();
+  size_t pos = 0;
+  return test_decode(stream, in, &pos, chunk);
+}
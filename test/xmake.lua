@@ -0,0 +1,80 @@
+-- Host builds of the tests, independent of the CHERIoT SDK:
+--
+--   xmake -P test && xmake test -P test
+--
+-- `test` and `test_encode` compare against reference files and take
+-- them as arguments, e.g. `xmake run -P test test image.png image.qoi`.
+set_project("QOI host tests")
+set_languages("c++20")
+
+add_includedirs("../include", ".")
+-- The decoder relies on tail calls, which are only made at -O2.
+set_optimize("faster")
+set_symbols("debug")
+
+target("test")
+    set_kind("binary")
+    add_files("test.cpp")
+    add_files("../lib/qoi_decode/qoi_decode.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace_passes.cc")
+
+target("test_decode")
+    set_kind("binary")
+    add_files("test_decode.cpp")
+    add_files("../lib/qoi_decode/qoi_decode.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace_passes.cc")
+    add_tests("default")
+
+target("test_containers")
+    set_kind("binary")
+    add_files("test_containers.cpp")
+    add_files("../lib/qoi_decode/qoi_decode.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace_passes.cc")
+    add_files("../lib/qoi_anim/qoi_anim.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace.cc")
+    add_tests("default")
+
+target("test_formats")
+    set_kind("binary")
+    add_files("test_formats.cpp")
+    add_files("../lib/qoi_decode/qoi_decode.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace_passes.cc")
+    add_files("../lib/qoi_encode/qoi_encode.cc")
+    add_tests("default")
+
+target("test_encode")
+    set_kind("binary")
+    add_files("test_encode.cpp")
+    add_files("../lib/qoi_decode/qoi_decode.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace_passes.cc")
+    add_files("../lib/qoi_encode/qoi_encode.cc")
+    add_files("../lib/qoi_encode/qoi_encode_host.cc")
+
+target("test_host")
+    set_kind("binary")
+    add_files("test_host.cpp")
+    add_files("../lib/qoi_decode/qoi_decode.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace_passes.cc")
+    add_files("../lib/qoi_encode/qoi_encode_host.cc")
+    add_files("../lib/qoi_lz/qoi_lz.cc")
+    add_tests("default")
+
+-- The same, with the AVX2 path of `qoi_encode_host`.
+target("test_host_avx2")
+    set_kind("binary")
+    add_files("test_host.cpp")
+    add_files("../lib/qoi_decode/qoi_decode.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace_passes.cc")
+    add_files("../lib/qoi_encode/qoi_encode_host.cc")
+    add_files("../lib/qoi_lz/qoi_lz.cc")
+    add_defines("QOI_TEST_AVX2")
+    add_cxflags("-mavx2")
+    add_tests("default")
+
+target("test_encoder")
+    set_kind("binary")
+    add_files("test_encoder.cpp")
+    add_files("../lib/qoi_decode/qoi_decode.cc")
+    add_files("../lib/qoi_interlace/qoi_interlace_passes.cc")
+    add_files("../lib/qoi_encode/qoi_encode.cc")
+    add_tests("default")